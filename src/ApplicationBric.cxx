@@ -16,8 +16,10 @@
 
 
 #include "ApplicationBric.h"
+#include "MRBric.h"
 
 #include <iostream>
+#include <fstream>
 
 #include <TROOT.h>
 #include <TSystem.h>
@@ -89,13 +91,38 @@ void ApplicationBric::applyConfig(const PropVal& config) {
 }
 
 
+void ApplicationBric::writeExecProfileReport(double wallTime) {
+	dbrx_log_info("Writing execution profile report to \"%s\"", profileReport.get());
+
+	Props profiles;
+	getExecProfiles(profiles);
+
+	Props report;
+	report["wallTime"] = wallTime;
+	report["brics"] = PropVal(std::move(profiles));
+
+	ofstream out(profileReport.get().c_str());
+	PropVal(std::move(report)).toJSON(out);
+	out << endl;
+	if (! out) throw runtime_error("Couldn't write execution profile report to \"%s\""_format(profileReport.get()));
+}
+
+
 void ApplicationBric::run() {
 	if (hasParent()) throw invalid_argument("Can't call run on bric \"%s\", not a top bric"_format(absolutePath()));
 
+	bool profiling = ! profileReport.get().empty();
+	if (profiling) ExecProfile::enabled(true);
+	int64_t startTime = ExecProfile::wallClockNow();
+
+	if (! scheduler.get().empty()) MRBric::defaultScheduler(scheduler);
+
 	initBricHierarchy();
 
 	assert(! execFinished());
 	while (!execFinished()) nextExecStep();
+
+	if (profiling) writeExecProfileReport(double(ExecProfile::wallClockNow() - startTime) * 1e-9);
 }
 
 
@@ -30,6 +30,8 @@ protected:
 
 	void postConfig() override;
 
+	virtual void writeExecProfileReport(double wallTime);
+
 public:
 	class AppBricGroup: public virtual Bric, public BricImpl {
 	protected:
@@ -52,6 +54,8 @@ public:
 
 	Param<std::vector<std::string>> requires{this, "requires", "Requirements to load before execution (e.g. libraries or scripts)"};
 	Param<std::string> logLevel{this, "logLevel", "Logging level", "info"};
+	Param<std::string> scheduler{this, "scheduler", "Default scheduler for inner brics of MR brics (\"layers\", \"readyQueue\" or \"workStealing\", empty for default)", ""};
+	Param<std::string> profileReport{this, "profileReport", "Output file for execution profile report in JSON format (profiling disabled if empty)", ""};
 
 	void applyConfig(const PropVal& config) override;
 
@@ -0,0 +1,92 @@
+// Copyright (C) 2014 Oliver Schulz <oschulz@mpp.mpg.de>
+
+// This is free software; you can redistribute it and/or modify it under
+// the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation; either version 2.1 of the License, or
+// (at your option) any later version.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+
+
+#include "Arena.h"
+
+#include <new>
+#include <cstdint>
+
+
+using namespace std;
+
+
+namespace dbrx {
+
+
+namespace {
+
+// Precedes each object allocated via newObject, keeps the alignment of
+// the object itself.
+struct alignas(std::max_align_t) ObjectHeader {
+	Arena *arena;
+};
+
+thread_local Arena *t_currentArena = nullptr;
+
+} // namespace
+
+
+constexpr size_t Arena::defaultBlockSize;
+
+
+Arena::Use::Use(Arena *arena): m_prev(t_currentArena) { t_currentArena = arena; }
+
+Arena::Use::~Use() { t_currentArena = m_prev; }
+
+
+Arena* Arena::current() { return t_currentArena; }
+
+
+void* Arena::newObject(size_t size) {
+	Arena *arena = t_currentArena;
+	size_t totalSize = sizeof(ObjectHeader) + size;
+	void *mem = (arena != nullptr) ? arena->allocate(totalSize, alignof(ObjectHeader)) : ::operator new(totalSize);
+	ObjectHeader *header = new(mem) ObjectHeader{arena};
+	return header + 1;
+}
+
+
+void Arena::deleteObject(void *p) {
+	if (p == nullptr) return;
+	ObjectHeader *header = static_cast<ObjectHeader*>(p) - 1;
+	if (header->arena == nullptr) ::operator delete(header);
+}
+
+
+void* Arena::allocate(size_t size, size_t alignment) {
+	uintptr_t pos = (reinterpret_cast<uintptr_t>(m_pos) + alignment - 1) & ~uintptr_t(alignment - 1);
+	if ((m_pos == nullptr) || (pos + size > reinterpret_cast<uintptr_t>(m_end))) {
+		// Large allocations get a block of their own, so the current block
+		// stays in use:
+		if (size + alignment > m_blockSize / 4) {
+			m_blocks.emplace_back(new char[size + alignment]);
+			m_nBytesAllocated += size;
+			uintptr_t start = reinterpret_cast<uintptr_t>(m_blocks.back().get());
+			return reinterpret_cast<void*>((start + alignment - 1) & ~uintptr_t(alignment - 1));
+		}
+		m_blocks.emplace_back(new char[m_blockSize]);
+		m_pos = m_blocks.back().get();
+		m_end = m_pos + m_blockSize;
+		pos = (reinterpret_cast<uintptr_t>(m_pos) + alignment - 1) & ~uintptr_t(alignment - 1);
+	}
+	m_pos = reinterpret_cast<char*>(pos + size);
+	m_nBytesAllocated += size;
+	return reinterpret_cast<void*>(pos);
+}
+
+
+} // namespace dbrx
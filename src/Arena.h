@@ -0,0 +1,87 @@
+// Copyright (C) 2014 Oliver Schulz <oschulz@mpp.mpg.de>
+
+// This is free software; you can redistribute it and/or modify it under
+// the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation; either version 2.1 of the License, or
+// (at your option) any later version.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+
+
+#ifndef DBRX_ARENA_H
+#define DBRX_ARENA_H
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+
+namespace dbrx {
+
+
+/// @brief Bump allocator for objects with a common lifetime.
+///
+/// Memory is taken from large blocks and only released, all at once, when
+/// the arena is destroyed. Objects in the arena still have to be destroyed
+/// individually (before the arena), e.g. via classes that use newObject
+/// and deleteObject as their operator new and delete.
+///
+/// Arenas are not thread-safe.
+
+class Arena {
+protected:
+	size_t m_blockSize;
+	std::vector< std::unique_ptr<char[]> > m_blocks;
+	char *m_pos = nullptr;
+	char *m_end = nullptr;
+	size_t m_nBytesAllocated = 0;
+
+public:
+	static constexpr size_t defaultBlockSize = 64 * 1024;
+
+	// Makes an arena the current arena of the calling thread, for the
+	// lifetime of the Use object (arena may be nullptr).
+	class Use final {
+	protected:
+		Arena *m_prev;
+
+	public:
+		Use(Arena *arena);
+		~Use();
+
+		Use(const Use &other) = delete;
+		Use& operator=(const Use &other) = delete;
+	};
+
+	static Arena* current();
+
+	// Allocates from the current arena, or from the heap if there is none.
+	static void* newObject(size_t size);
+
+	// Frees memory allocated by newObject, unless it belongs to an arena.
+	static void deleteObject(void *p);
+
+	size_t blockSize() const { return m_blockSize; }
+	size_t nBytesAllocated() const { return m_nBytesAllocated; }
+
+	void* allocate(size_t size, size_t alignment = alignof(std::max_align_t));
+
+	Arena(size_t blockSize = defaultBlockSize): m_blockSize(blockSize) {}
+
+	Arena(const Arena &other) = delete;
+	Arena& operator=(const Arena &other) = delete;
+
+	virtual ~Arena() {}
+};
+
+
+} // namespace dbrx
+
+#endif // DBRX_ARENA_H
@@ -20,6 +20,11 @@
 #include <iostream>
 #include <algorithm>
 #include <sstream>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include <TROOT.h>
 
 #include "TypeReflection.h"
 
@@ -74,6 +79,7 @@ void Bric::InputTerminal::connectTo(Bric::Terminal &other) {
 	dbrx_log_trace("Connecting input terminal \"%s\" to terminal \"%s\"", absolutePath(), other.absolutePath());
 	value().referTo(other.value());
 	setSrcTerminal(&other);
+	other.m_consumers.push_back(this);
 	setEffSrcBric( parent().addSource(&other.parent()) );
 }
 
@@ -84,7 +90,29 @@ const PropKey Bric::s_defaultOutputName("output");
 const PropKey Bric::s_bricTypeKey("type");
 
 
+std::map<std::string, Bric::BricFactory>& Bric::bricTypeRegistry() {
+	static std::map<std::string, BricFactory> registry;
+	return registry;
+}
+
+
+void Bric::enableArena(size_t blockSize) {
+	if (hasParent()) throw invalid_argument("Can't enable arena for bric \"%s\", not a top bric"_format(absolutePath()));
+	if (! m_dynBrics.empty() || ! m_dynTerminals.empty()) throw logic_error("Can't enable arena for bric \"%s\" after dynamic components have been created"_format(absolutePath()));
+	if (! m_arena) m_arena = unique_ptr<Arena>(new Arena(blockSize));
+}
+
+
+void Bric::registerBricType(const std::string &className, BricFactory factory) {
+	dbrx_log_debug("Registering native factory for bric type \"%s\"", className);
+	bricTypeRegistry()[className] = std::move(factory);
+}
+
+
 std::unique_ptr<Bric> Bric::createBricFromTypeName(const std::string &className) {
+	auto registered = bricTypeRegistry().find(className);
+	if (registered != bricTypeRegistry().end()) return registered->second();
+
 	// For some reason, objects created via "newInstance<Bric>" are unstable
 	// and produce segfaults. May be some problem with virtual tables and may
 	// be related to Bric virtual inheritance hierarchy. As a workaround,
@@ -201,6 +229,7 @@ Bric* Bric::addDynBric(std::unique_ptr<Bric> dynBric) {
 Bric* Bric::addDynBric(PropKey bricName, const PropVal& config) {
 	if (!isBricConfig(config)) throw invalid_argument("Invalid configuration format for dynamic sub-bric \"%s\" in bric \"%s\""_format(bricName, absolutePath()));
 	dbrx_log_debug("Creating dynamic bric \"%s\" inside bric \"%s\""_format(bricName, absolutePath()));
+	Arena::Use useArena(arena());
 	Props subBricProps = config.asProps();
 	std::string className = config.at(s_bricTypeKey).asString();
 	unique_ptr<Bric> dynBric = createBricFromTypeName(className);
@@ -295,7 +324,10 @@ void Bric::disconnectInputs() {
 	m_hasExternalSources = false;
 	m_inputsConnected = false;
 
+	for (const auto& terminal: m_terminals) terminal.second->m_consumers.clear();
+
 	m_dests.clear();
+	m_outputsToRelease.clear();
 
 	m_dynTerminals.clear();
 }
@@ -336,6 +368,8 @@ void Bric::initRecursive() {
 	initTDirectory();
 	TempChangeOfTDirectory tDirChange(localTDirectory());
 
+	m_execProfile.clear();
+
 	for (auto &entry: m_brics) entry.second->initRecursive();
 	dbrx_log_debug("Run init for bric \"%s\", sources [%s], dests [%s]"_format(
 		absolutePath(),
@@ -346,8 +380,19 @@ void Bric::initRecursive() {
 }
 
 
+void Bric::enableConcurrentExec() {
+	static once_flag enabled;
+	call_once(enabled, []{
+		dbrx_log_debug("Enabling ROOT thread safety for concurrent bric execution");
+		ROOT::EnableThreadSafety();
+	});
+}
+
+
 void Bric::initTDirectory() {
-	m_tDirectory = unique_ptr<TDirectory>(new TDirectory(name().toString().c_str(), title().c_str()));
+	// Explicit mother directory, gDirectory may belong to a different context:
+	TDirectory *motherDir = hasParent() ? parent().localTDirectory() : nullptr;
+	m_tDirectory = unique_ptr<TDirectory>(new TDirectory(name().toString().c_str(), title().c_str(), "", motherDir));
 	dbrx_log_debug("Created new TDirectory for bric \"%s\" with path \"%s\""_format(absolutePath(), localTDirectory()->GetPath()));
 }
 
@@ -386,6 +431,14 @@ void Bric::applyConfig(const PropVal& config) {
 }
 
 
+void Bric::getExecProfiles(Props &profiles) const {
+	PropVal profile = m_execProfile.toPropVal();
+	profile["type"] = TypeReflection(typeid(*this)).name();
+	profiles[absolutePath().toString()] = std::move(profile);
+	for (const auto &entry: m_brics) entry.second->getExecProfiles(profiles);
+}
+
+
 PropVal Bric::getConfig() const  {
 	Props props;
 	for (const auto& entry: m_components) {
@@ -552,6 +605,7 @@ void Bric::addDynInput(std::unique_ptr<Bric::InputTerminal> terminal) {
 void Bric::initBricHierarchy() {
 	if (hasParent()) throw invalid_argument("Can't init bric hierarchy starting from bric \"%s\", not a top bric"_format(absolutePath()));
 
+	Arena::Use useArena(arena());
 	disconnectInputs();
 	connectInputs();
 	initRecursive();
@@ -583,6 +637,14 @@ std::ostream & Bric::printInfo(std::ostream &os) const {
 }
 
 
+void Bric::releaseUsedOutputs() {
+	for (OutputTerminal *output: m_outputsToRelease) {
+		if (output->afterUse() == OutputTerminal::AfterUse::RELEASE) output->value().clear();
+		else output->value().setToDefault();
+	}
+}
+
+
 Bric* Bric::addSource(Bric *source) {
 	Bric* dstBric = this;
 	Bric* srcBric = source;
@@ -608,4 +670,357 @@ Bric* Bric::addSource(Bric *source) {
 }
 
 
+class MapperBric::Pipeline final {
+public:
+	using Mutex = std::mutex;
+	using Lock = std::unique_lock<Mutex>;
+
+	enum class Job: int32_t { NONE = 0, INPUT = 1, FINAL = 2 };
+
+protected:
+	MapperBric *m_bric;
+
+	std::vector<WritableValue*> m_outputs;
+	std::vector<bool> m_swapOutput;
+	std::vector< std::unique_ptr<PrimaryValue> > m_front;
+	std::vector< std::vector< std::unique_ptr<PrimaryValue> > > m_slots;
+
+	Mutex m_mutex;
+	std::condition_variable m_producerWakeup;
+	std::condition_variable m_consumerWakeup;
+
+	size_t m_head = 0;
+	size_t m_nFilled = 0;
+	Job m_pendingJob = Job::NONE;
+	bool m_jobActive = false;
+	bool m_cancel = false;
+	bool m_stop = false;
+
+	// Only accessed by consumer, or by producer while job is active:
+	bool m_busy = false;
+	std::string m_inputError;
+	std::string m_outputError;
+
+	std::thread m_thread;
+
+
+	void produce(Job job) {
+		TempChangeOfTDirectory tDirChange(m_bric->localTDirectory());
+
+		if (job == Job::INPUT) {
+			try {
+				ExecProfile::Timer timer(m_bric->m_execProfile, ExecProfile::Section::PROCESS_INPUT);
+				m_bric->processInput();
+			}
+			catch(const std::exception &e) { m_inputError = e.what(); return; }
+		}
+
+		while (true) {
+			bool producedOutput = false;
+			try {
+				ExecProfile::Timer timer(m_bric->m_execProfile, ExecProfile::Section::NEXT_OUTPUT);
+				producedOutput = (job == Job::INPUT) ? m_bric->nextOutput() : m_bric->nextFinalOutput();
+			}
+			catch(const std::exception &e) { m_outputError = e.what(); return; }
+			if (!producedOutput) return;
+
+			Lock lock(m_mutex);
+			m_producerWakeup.wait(lock, [&]{ return m_stop || m_cancel || (m_nFilled < m_slots.size()); });
+			if (m_stop || m_cancel) return;
+			auto &slot = m_slots[(m_head + m_nFilled) % m_slots.size()];
+			lock.unlock();
+
+			for (size_t i = 0; i < m_outputs.size(); ++i) {
+				if (m_swapOutput[i]) slot[i]->swapContent(*m_outputs[i]);
+				else slot[i]->assignContentFrom(*m_outputs[i]);
+			}
+
+			lock.lock();
+			if (m_cancel) return;
+			++m_nFilled;
+			m_consumerWakeup.notify_all();
+		}
+	}
+
+
+	void producerLoop() {
+		Lock lock(m_mutex);
+		while (true) {
+			m_producerWakeup.wait(lock, [&]{ return m_stop || (m_pendingJob != Job::NONE); });
+			if (m_stop) return;
+
+			Job job = m_pendingJob;
+			m_pendingJob = Job::NONE;
+			lock.unlock();
+			produce(job);
+			lock.lock();
+			m_jobActive = false;
+			m_consumerWakeup.notify_all();
+		}
+	}
+
+public:
+	bool busy() const { return m_busy; }
+
+	const std::string& inputError() const { return m_inputError; }
+	const std::string& outputError() const { return m_outputError; }
+
+	const std::vector< std::unique_ptr<PrimaryValue> >& front() const { return m_front; }
+
+	void start(Job job) {
+		assert(!m_busy); // Sanity check
+		m_inputError.clear();
+		m_outputError.clear();
+		// Producer thread only runs during execution, see stop:
+		if (! m_thread.joinable()) m_thread = std::thread([this]{ producerLoop(); });
+		Lock lock(m_mutex);
+		m_pendingJob = job;
+		m_jobActive = true;
+		m_busy = true;
+		m_producerWakeup.notify_all();
+	}
+
+	// Waits for the next output of the current job and moves it to the front
+	// values. Returns false if the job finished without further output.
+	bool nextOutput() {
+		assert(m_busy); // Sanity check
+		Lock lock(m_mutex);
+		m_consumerWakeup.wait(lock, [&]{ return (m_nFilled > 0) || !m_jobActive; });
+		if (m_nFilled > 0) {
+			auto &slot = m_slots[m_head];
+			for (size_t i = 0; i < m_front.size(); ++i) m_front[i]->swapContent(*slot[i]);
+			m_head = (m_head + 1) % m_slots.size();
+			--m_nFilled;
+			m_producerWakeup.notify_all();
+			return true;
+		} else {
+			m_busy = false;
+			return false;
+		}
+	}
+
+	// Discards buffered outputs and stops the current job
+	void cancel() {
+		Lock lock(m_mutex);
+		if (m_pendingJob != Job::NONE) {
+			m_pendingJob = Job::NONE;
+			m_jobActive = false;
+		}
+		m_cancel = true;
+		m_producerWakeup.notify_all();
+		m_consumerWakeup.wait(lock, [&]{ return !m_jobActive; });
+		m_cancel = false;
+		m_head = 0;
+		m_nFilled = 0;
+		m_busy = false;
+	}
+
+	Pipeline(MapperBric *bric, const std::vector<OutputTerminal*> &outputs, size_t depth)
+		: m_bric(bric)
+	{
+		for (OutputTerminal *output: outputs) {
+			m_outputs.push_back(&output->value());
+			m_swapOutput.push_back(bric->pipelineCanSwapOutput(*output));
+			m_front.push_back(output->value().createMatchingValue());
+			m_front.back()->assignContentFrom(output->value());
+		}
+
+		m_slots.resize(depth);
+		for (auto &slot: m_slots)
+			for (OutputTerminal *output: outputs) slot.push_back(output->value().createMatchingValue());
+	}
+
+	// Stops the current job and joins the producer thread, it is restarted
+	// by the next job
+	void stop() {
+		cancel();
+		if (! m_thread.joinable()) return;
+		Lock lock(m_mutex);
+		m_stop = true;
+		m_producerWakeup.notify_all();
+		lock.unlock();
+		m_thread.join();
+		m_stop = false;
+	}
+
+	~Pipeline() { stop(); }
+};
+
+
+void MapperBric::PipelineDeleter::operator()(Pipeline *pipeline) const {
+	delete pipeline;
+}
+
+
+void MapperBric::collectOutputs(Bric &bric, std::vector<OutputTerminal*> &outputs) {
+	for (auto &output: bric.m_outputs) outputs.push_back(output.second);
+	for (auto &inner: bric.m_brics) collectOutputs(*inner.second, outputs);
+}
+
+
+void MapperBric::redirectInputs(Bric &bric, const Value &from, const Value &to) {
+	for (auto &input: bric.m_inputs) {
+		auto &inputValue = input.second->value();
+		if (inputValue.untypedPPtr() == from.untypedPPtr()) {
+			dbrx_log_trace("Redirecting input \"%s\" to pipeline output", input.second->absolutePath());
+			inputValue.referTo(to);
+		}
+	}
+	for (auto &inner: bric.m_brics) redirectInputs(*inner.second, from, to);
+}
+
+
+bool TransformBric::fusedCanMakeProgress() const {
+	if (canMakeProgress()) return true;
+	for (const TransformBric *bric: m_fusedBrics) if (bric->canMakeProgress()) return true;
+	return false;
+}
+
+
+bool TransformBric::nextFusedExecStep() {
+	if (m_fusedBrics.empty()) return nextExecStep();
+
+	bool chainIdle = !execFinished() && allSourcesAvailable() && allDestsReadyForInput();
+	for (const TransformBric *bric: m_fusedBrics) {
+		chainIdle = chainIdle && !bric->execFinished()
+			&& (bric->nSourcesAvailable() == 0) && bric->allDestsReadyForInput();
+	}
+
+	if (chainIdle) {
+		// Fast path, pass input directly through the chain:
+		consumeInput();
+		for (size_t i = 0; i <= m_fusedBrics.size(); ++i) {
+			TransformBric *bric = (i == 0) ? this : m_fusedBrics[i - 1];
+			ExecProfile::Timer timer(bric->m_execProfile, ExecProfile::Section::EXEC_STEP);
+			TempChangeOfTDirectory tDirChange(bric->localTDirectory());
+			bric->tryProcessInput();
+			++bric->m_execCounter;
+			if (bric != m_fusedBrics.back()) bric->m_execProfile.countOutput();
+		}
+		TransformBric *tail = m_fusedBrics.back();
+		if (tail->hasDests()) tail->announceNewOutput();
+		announceReadyForInput();
+		// Rest of the chain will finish in subsequent steps:
+		if (allSourcesFinished() && (nSourcesAvailable() == 0)) setExecFinished();
+		return true;
+	} else {
+		// Input pending somewhere in the chain or finishing, execute brics
+		// one by one (brics that can't make progress would do nothing):
+		bool execResult = canMakeProgress() ? nextExecStep() : execFinished();
+		for (TransformBric *bric: m_fusedBrics)
+			execResult = bric->canMakeProgress() ? bric->nextExecStep() : bric->execFinished();
+		return execResult;
+	}
+}
+
+
+void MapperBric::initPipeline() {
+	m_pipeline.reset();
+
+	if (pipelineDepth < 0) throw invalid_argument("Invalid pipeline depth %s for bric \"%s\""_format(pipelineDepth.get(), absolutePath()));
+
+	if (pipelineDepth > 0) {
+		dbrx_log_debug("Enabling pipelined execution with depth %s for bric \"%s\"", pipelineDepth.get(), absolutePath());
+
+		std::vector<OutputTerminal*> outputs;
+		collectOutputs(*this, outputs);
+
+		// Pipeline runs the bric on a separate thread:
+		enableConcurrentExec();
+
+		try { m_pipeline.reset(new Pipeline(this, outputs, size_t(pipelineDepth))); }
+		catch(const std::invalid_argument &e) {
+			throw invalid_argument("Can't use pipelined execution for bric \"%s\": %s"_format(absolutePath(), e.what()));
+		}
+
+		// Dests have to read the pipeline front values instead of the outputs
+		Bric *topBric = this;
+		while (topBric->hasParent()) topBric = &topBric->parent();
+		for (size_t i = 0; i < outputs.size(); ++i)
+			redirectInputs(*topBric, outputs[i]->value(), *m_pipeline->front()[i]);
+	}
+}
+
+
+void MapperBric::initRecursive() {
+	Bric::initRecursive();
+	initPipeline();
+}
+
+
+void MapperBric::resetExec() {
+	SyncedInputBric::resetExec();
+	m_producingFinalOutputs = false;
+	stopPipeline();
+}
+
+
+void MapperBric::stopPipeline() {
+	if (m_pipeline != nullptr) m_pipeline->stop();
+}
+
+
+bool MapperBric::pipelinedNextExecStep() {
+	using Job = Pipeline::Job;
+
+	bool producedOutput = false;
+
+	if (allDestsReadyForInput()) {
+		bool inputDone = false;
+
+		while (!producedOutput && !execFinished()) {
+			if (! m_pipeline->busy()) {
+				if (!inputDone && !m_producingFinalOutputs && allSourcesAvailable()) {
+					consumeInput();
+					m_pipeline->start(Job::INPUT);
+				} else if (allSourcesFinished()) {
+					if (!m_producingFinalOutputs) {
+						// All input processed, give bric a chance to flush buffered data
+						m_producingFinalOutputs = true;
+						m_pipeline->start(Job::FINAL);
+					} else {
+						setExecFinished();
+						stopPipeline();
+						break;
+					}
+				} else {
+					announceReadyForInput();
+					break;
+				}
+			}
+
+			if (m_pipeline->nextOutput()) {
+				if (hasDests()) announceNewOutput();
+				else announceReadyForInput();
+				producedOutput = true;
+			} else {
+				if (! m_pipeline->outputError().empty()) {
+					dbrx_log_error("Producing next output failed in bric \"%s\": %s", absolutePath(), m_pipeline->outputError());
+					for (auto &value: m_pipeline->front()) value->setToDefault();
+				}
+
+				if (! m_pipeline->inputError().empty()) {
+					dbrx_log_error("Processing input failed in bric \"%s\": %s", absolutePath(), m_pipeline->inputError());
+					for (auto &value: m_pipeline->front()) value->setToDefault();
+					setExecFinished();
+					stopPipeline();
+				} else if (!m_producingFinalOutputs) {
+					announceReadyForInput();
+					inputDone = true;
+				}
+			}
+		}
+	}
+
+	return producedOutput || execFinished();
+}
+
+
+MapperBric::~MapperBric() {
+	// Pipeline is normally already stopped when execution finishes or is
+	// reset, so this is just a fallback:
+	stopPipeline();
+}
+
+
 } // namespace dbrx
@@ -19,16 +19,20 @@
 #define DBRX_BRIC_H
 
 #include <memory>
+#include <functional>
 #include <atomic>
 #include <stdexcept>
 #include <map>
+#include <deque>
 #include <iosfwd>
 
 #include <TDirectory.h>
 
+#include "Arena.h"
 #include "Props.h"
 #include "Printable.h"
 #include "HasValue.h"
+#include "ExecProfile.h"
 #include "logging.h"
 
 
@@ -98,6 +102,13 @@ public:
 
 	virtual bool isInside(const Bric& other) const final;
 
+	// Dynamically created components are allocated in the current arena
+	// (see Bric::arena()), if any.
+	static void* operator new(size_t size) { return Arena::newObject(size); }
+	static void* operator new(size_t size, void *p) { return p; }
+	static void operator delete(void *p) { Arena::deleteObject(p); }
+	static void operator delete(void *p, void *place) {}
+
 	friend class Bric;
 };
 
@@ -152,16 +163,44 @@ public:
 
 
 	class Terminal: public virtual BricComponent, public virtual HasValue {
+	protected:
+		std::vector<InputTerminal*> m_consumers;
+
 	public:
+		// Inputs connected to this terminal
+		const std::vector<InputTerminal*>& consumers() const { return m_consumers; }
+
+		// Number of inputs connected to this terminal
+		size_t nConsumers() const { return m_consumers.size(); }
+
 		virtual OutputTerminal* createMatchingDynOutput(Bric* outputBric,
 			PropKey outputName, std::string outputTitle = "") = 0;
 
 		virtual InputTerminal* createMatchingDynInput(Bric* inputBric,
 			PropKey inputName, std::string inputTitle = "") = 0;
+
+		friend class Bric;
+		friend class InputTerminal;
 	};
 
 
-	class OutputTerminal: public virtual Terminal, public virtual HasWritableValue {};
+	class OutputTerminal: public virtual Terminal, public virtual HasWritableValue {
+	public:
+		// What happens to the output value after all dests of the bric have
+		// used it: RESET sets it to it's default value, RELEASE deletes it's
+		// content (the bric must assign a new value before the next output).
+		// Not suitable for values referenced from elsewhere (e.g. by tree
+		// branch addresses). Only applied if the lifetime analysis of the
+		// enclosing MR bric permits it.
+		enum class AfterUse: int32_t { KEEP = 0, RESET = 1, RELEASE = 2 };
+
+	protected:
+		AfterUse m_afterUse = AfterUse::KEEP;
+
+	public:
+		AfterUse afterUse() const { return m_afterUse; }
+		void afterUse(AfterUse policy) { m_afterUse = policy; }
+	};
 
 
 	class InputTerminal: public virtual Terminal, public virtual HasConstValueRef {
@@ -178,6 +217,14 @@ public:
 
 		virtual const Bric* effSrcBric() const = 0;
 
+		// Whether the content of the source can be taken over instead of
+		// copied, requires the source to be an output without other
+		// consumers.
+		virtual bool canTake() const = 0;
+
+		// Untyped version of Input<T>::take().
+		virtual void* untypedTake() = 0;
+
 		virtual void connectTo(Terminal &other) final;
 	};
 
@@ -185,6 +232,10 @@ public:
 	class ParamTerminal : public virtual Terminal, public virtual HasWritableValue {};
 
 protected:
+	// Changes gDirectory for the current scope. gDirectory is thread-local
+	// after enableConcurrentExec, so this only affects the current thread.
+	// Brics should still create ROOT objects in explicit directories (e.g.
+	// via SetDirectory) where possible, instead of relying on gDirectory.
 	class TempChangeOfTDirectory final {
 	protected:
 		TDirectory* m_prev = nullptr;
@@ -212,8 +263,18 @@ protected:
 	static const PropKey s_defaultOutputName;
 	static const PropKey s_bricTypeKey;
 
+	static std::map<std::string, std::function<std::unique_ptr<Bric>()>>& bricTypeRegistry();
+
 	static std::unique_ptr<Bric> createBricFromTypeName(const std::string &className);
 
+	// Has to be called before brics are executed on multiple threads
+	// (enables ROOT thread safety, which makes gDirectory thread-local).
+	static void enableConcurrentExec();
+
+
+	// Only used in top brics, declared first so it's destroyed after all
+	// dynamic components.
+	std::unique_ptr<Arena> m_arena;
 
 	std::map<PropKey, BricComponent*> m_components;
 	std::map<PropKey, Bric*> m_brics;
@@ -427,6 +488,96 @@ public:
 	// virtual void init_childrenFirst() {};
 
 
+// Bric types //
+
+public:
+	using BricFactory = std::function<std::unique_ptr<Bric>()>;
+
+	// Registers a native factory for a bric type, used instead of ROOT
+	// reflection when creating dynamic brics of that type (e.g. by
+	// pipelines compiled with "dbrx compile").
+	static void registerBricType(const std::string &className, BricFactory factory);
+
+
+// Memory //
+
+public:
+	// Enables allocation of dynamic brics and terminals of this bric
+	// hierarchy in an arena, to keep them close together in memory. Arena
+	// memory is released when this bric is destroyed. Only possible for top
+	// brics, has to be called before the hierarchy is configured.
+	void enableArena(size_t blockSize = Arena::defaultBlockSize);
+
+	// Arena of the top bric of the hierarchy, nullptr if not enabled.
+	Arena* arena() { return hasParent() ? parent().arena() : m_arena.get(); }
+
+
+// Scheduling //
+
+public:
+	// Interface for schedulers that execute brics when notified that they
+	// may be able to make progress. A bric attached to a scheduler notifies
+	// it when its sources, dests or finished sources change.
+	class Scheduler {
+	protected:
+		enum SchedState: uint8_t { IDLE = 0, QUEUED = 1, RUNNING = 2, RUNNING_NOTIFIED = 3 };
+
+		static std::atomic<uint8_t>& schedState(Bric *bric) { return bric->m_schedState; }
+
+	public:
+		virtual void bricReady(Bric *bric) = 0;
+
+		virtual ~Scheduler() {}
+	};
+
+
+	// Queue of brics that may be able to make progress, for sequential
+	// execution. Each bric is queued at most once at a time.
+	class ReadyQueue final: public Scheduler {
+	protected:
+		std::deque<Bric*> m_brics;
+
+	public:
+		bool empty() const { return m_brics.empty(); }
+
+		void push(Bric *bric) {
+			if (atomic_load(&schedState(bric)) == IDLE) {
+				atomic_store(&schedState(bric), uint8_t(QUEUED));
+				m_brics.push_back(bric);
+			}
+		}
+
+		Bric* pop() {
+			Bric *bric = m_brics.front();
+			m_brics.pop_front();
+			atomic_store(&schedState(bric), uint8_t(IDLE));
+			return bric;
+		}
+
+		void clear() { while (!empty()) pop(); }
+
+		void bricReady(Bric *bric) override { push(bric); }
+	};
+
+protected:
+	Scheduler *m_scheduler = nullptr;
+	std::atomic<uint8_t> m_schedState{0};
+	Bric *m_fusedHead = nullptr;
+
+	virtual void markReady() final {
+		if (m_scheduler != nullptr) m_scheduler->bricReady((m_fusedHead != nullptr) ? m_fusedHead : this);
+	}
+
+public:
+	// Set by the parent bric, if it schedules its inner brics based on
+	// notifications (instead of executing all of them in each step).
+	virtual void scheduler(Scheduler *sched) final { m_scheduler = sched; }
+
+	// Set by the parent bric if this bric is executed as part of a fused
+	// unit (see TransformBric::fuse), notifications go to the unit's head.
+	virtual void fusedHead(Bric *head) final { m_fusedHead = head; }
+
+
 // Sources //
 
 protected:
@@ -444,7 +595,7 @@ protected:
 	virtual bool hasSources() const final { return ! m_sources.empty(); }
 	virtual size_t nSources() const final { return m_sources.size(); }
 
-	virtual void incNSourcesAvailable() final { atomic_fetch_add(&m_nSourcesAvailable, size_t(1)); }
+	virtual void incNSourcesAvailable() final { atomic_fetch_add(&m_nSourcesAvailable, size_t(1)); markReady(); }
 	virtual void decNSourcesAvailable() final { atomic_fetch_sub(&m_nSourcesAvailable, size_t(1)); }
 	virtual void clearNSourcesAvailable() final { atomic_store(&m_nSourcesAvailable, size_t(0)); }
 
@@ -464,7 +615,7 @@ protected:
 		{ return nSourcesAvailable() > 0 || otherSourcesAvailable(); }
 
 
-	virtual void incSourcesFinished() final { atomic_fetch_add(&m_nSourcesFinished, size_t(1)); }
+	virtual void incSourcesFinished() final { atomic_fetch_add(&m_nSourcesFinished, size_t(1)); markReady(); }
 
 	virtual size_t nSourcesFinished() const final {
 		size_t nFinished = atomic_load(&m_nSourcesFinished);
@@ -487,15 +638,35 @@ protected:
 
 	std::atomic<size_t> m_nDestsReadyForInput;
 
-	size_t m_outputCounter;
+	std::atomic<size_t> m_outputCounter{0};
 
-	static size_t outputCounterOn(const Bric &other) { return other.m_outputCounter; }
+	static size_t outputCounterOn(const Bric &other) { return atomic_load(&other.m_outputCounter); }
 
 
 	virtual bool hasDests() const final { return ! m_dests.empty(); }
 	virtual size_t nDests() const final { return m_dests.size(); }
 
-	virtual void incNDestsReadyForInput() final { atomic_fetch_add(&m_nDestsReadyForInput, size_t(1)); }
+	// Outputs to reset or release after all dests have used them, as
+	// determined by the lifetime analysis of the enclosing MR bric:
+	std::vector<OutputTerminal*> m_outputsToRelease;
+	std::atomic<size_t> m_nDestsDoneWithOutput{0};
+
+	virtual void releaseUsedOutputs() final;
+
+	// The last dest done with the output releases it, before this bric can
+	// see all dests ready and produce new output:
+	virtual void incNDestsDoneWithOutput() final {
+		if (!m_outputsToRelease.empty() && (atomic_fetch_add(&m_nDestsDoneWithOutput, size_t(1)) + 1 == nDests())) {
+			atomic_store(&m_nDestsDoneWithOutput, size_t(0));
+			releaseUsedOutputs();
+		}
+	}
+
+	virtual void incNDestsReadyForInput() final {
+		incNDestsDoneWithOutput();
+		atomic_fetch_add(&m_nDestsReadyForInput, size_t(1));
+		markReady();
+	}
 	virtual void clearNDestsReadyForInput() final { atomic_store(&m_nDestsReadyForInput, size_t(0)); }
 
 	virtual size_t nDestsReadyForInput() const final {
@@ -508,9 +679,12 @@ protected:
 
 
 	virtual void announceNewOutput() final {
-		for (auto &dest: m_dests) dest->incNSourcesAvailable();
+		// Dests may run concurrently and react immediately, so update state
+		// before notifying them:
 		clearNDestsReadyForInput();
-		++m_outputCounter;
+		atomic_fetch_add(&m_outputCounter, size_t(1));
+		m_execProfile.countOutput();
+		for (auto &dest: m_dests) dest->incNSourcesAvailable();
 	}
 
 	virtual void setExecFinished() final {
@@ -530,6 +704,8 @@ protected:
 	bool m_execFinished = false;
 	size_t m_execCounter = 0;
 
+	ExecProfile m_execProfile;
+
 
 	// See nextExecStep for guarantees on behaviour and return value.
 	virtual bool nextExecStepImpl() = 0;
@@ -547,6 +723,7 @@ public:
 		atomic_store(&m_nSourcesAvailable, size_t(0));
 		atomic_store(&m_nSourcesFinished, size_t(0));
 		atomic_store(&m_nDestsReadyForInput, nDests());
+		atomic_store(&m_nDestsDoneWithOutput, size_t(0));
 		m_execFinished = false;
 		m_execCounter = false;
 	}
@@ -557,6 +734,7 @@ public:
 	// true if bric execution is finished and false if not.
 	virtual bool nextExecStep() final {
 		if (!execFinished()) {
+			ExecProfile::Timer timer(m_execProfile, ExecProfile::Section::EXEC_STEP);
 			TempChangeOfTDirectory tDirChange(localTDirectory());
 			bool result = nextExecStepImpl();
 			++m_execCounter;
@@ -566,8 +744,24 @@ public:
 
 	virtual bool execFinished() const final { return m_execFinished; }
 
+	// Like nextExecStep and execFinished, but for the unit of brics fused
+	// with this one. Schedulers execute brics via these.
+	virtual bool nextFusedExecStep() { return nextExecStep(); }
+	virtual bool fusedExecFinished() const { return execFinished(); }
+
 	virtual size_t execCounter() const final { return m_execCounter; }
 
+	virtual const ExecProfile& execProfile() const final { return m_execProfile; }
+
+	// Adds the execution profiles of this bric and all inner brics to
+	// profiles, with the absolute bric paths as keys.
+	virtual void getExecProfiles(Props &profiles) const;
+
+	// Whether nextExecStep may run concurrently with the nextExecStep of
+	// other, independent brics (e.g. in a multi-threaded MRBric). Override
+	// and return false for brics that access non-thread-safe global state.
+	virtual bool canRunConcurrently() const { return true; }
+
 
 public:
 	friend class BricImpl;
@@ -578,10 +772,13 @@ public:
 	friend class ProcessingBric;
 	friend class ImportBric;
 	friend class TransformBric;
+	friend class FilterBric;
 	friend class MapperBric;
 	friend class AbstractReducerBric;
 	friend class ReducerBric;
 	friend class AsyncReducerBric;
+	friend class MRBric;
+	friend class PipelineCompiler;
 };
 
 
@@ -683,10 +880,14 @@ public:
 	{
 	protected:
 		PropPath m_source;
-		const Bric* m_effSrcBric;
-		const Terminal *m_srcTerminal;
+		const Bric* m_effSrcBric = nullptr;
+		const Terminal *m_srcTerminal = nullptr;
 		TypedPrimaryValue<T> m_fixedValue;
 
+		TypedWritableValue<T>* writableSource() const {
+			return dynamic_cast<TypedWritableValue<T>*>(const_cast<Value*>(value().source()));
+		}
+
 		virtual void setSrcTerminal(const Terminal* terminal) final { m_srcTerminal = terminal; }
 		virtual void setEffSrcBric(const Bric* bric) final { m_effSrcBric = bric; }
 
@@ -718,6 +919,26 @@ public:
 
 		const Bric* effSrcBric() const final override { return m_effSrcBric; }
 
+		bool canTake() const final override {
+			return (m_srcTerminal != nullptr) && (m_srcTerminal->nConsumers() == 1)
+				&& (dynamic_cast<const OutputTerminal*>(m_srcTerminal) != nullptr)
+				&& (writableSource() != nullptr);
+		}
+
+		// Takes the content of the source output instead of copying it, the
+		// output gets new default content. Only allowed if canTake(). The
+		// source bric has to assign new content to the output for each new
+		// output (instead of modifying its previous content).
+		std::unique_ptr<T> take() {
+			if (! canTake()) throw std::logic_error("Can't take content of input \"%s\", source is not an output with a single consumer"_format(absolutePath()));
+			TypedWritableValue<T> *source = writableSource();
+			std::unique_ptr<T> content(source->release());
+			source->setToDefault();
+			return content;
+		}
+
+		void* untypedTake() final override { return take().release(); }
+
 		Input() : m_fixedValue(nullptr) {}
 
 		Input(BricWithInputs *parentBric, PropKey inputName = PropKey(), std::string inputTitle = "")
@@ -732,6 +953,7 @@ public:
 
 protected:
 	virtual void tryProcessInput() final {
+		ExecProfile::Timer timer(m_execProfile, ExecProfile::Section::PROCESS_INPUT);
 		try{ processInput(); }
 		catch(const std::exception &e) {
 			dbrx_log_error("Processing input failed in bric \"%s\": %s", absolutePath(), e.what());
@@ -752,6 +974,7 @@ public:
 template <typename T> Bric::OutputTerminal* Bric::TypedTerminal<T>::createMatchingDynOutput (
 	Bric* outputBric, PropKey outputName, std::string outputTitle
 ) {
+	Arena::Use useArena(outputBric->arena());
 	std::unique_ptr<Bric::OutputTerminal> terminal (
 		new typename BricWithOutputs::Output<T>(nullptr, outputName, outputTitle)
 	);
@@ -764,6 +987,7 @@ template <typename T> Bric::OutputTerminal* Bric::TypedTerminal<T>::createMatchi
 template <typename T> Bric::InputTerminal* Bric::TypedTerminal<T>::createMatchingDynInput (
 	Bric* inputBric, PropKey inputName, std::string inputTitle
 ) {
+	Arena::Use useArena(inputBric->arena());
 	std::unique_ptr<Bric::InputTerminal> terminal (
 		new typename BricWithInputs::Input<T>(nullptr, inputName, inputTitle)
 	);
@@ -779,8 +1003,11 @@ protected:
 	bool m_consumedInput = false;
 
 	virtual void announceReadyForInput() final {
-		if (m_consumedInput && !allSourcesFinished()) {
-			for (auto &source: m_sources) source->incNDestsReadyForInput();
+		if (m_consumedInput) {
+			// Finished sources don't need to know about readiness, but may
+			// still have to release their last output:
+			if (!allSourcesFinished()) for (auto &source: m_sources) source->incNDestsReadyForInput();
+			else for (auto &source: m_sources) source->incNDestsDoneWithOutput();
 			m_consumedInput = false;
 		}
 	}
@@ -819,7 +1046,10 @@ public:
 		if (!m_importDone) {
 			dbrx_log_trace("Importer %s, running import", absolutePath());
 
-			try{ import(); }
+			try {
+				ExecProfile::Timer timer(m_execProfile, ExecProfile::Section::IMPORT);
+				import();
+			}
 			catch(const std::exception &e) {
 				dbrx_log_error("Running import failed in bric \"%s\": %s", absolutePath(), e.what());
 				setOutputsToErrorState();
@@ -847,27 +1077,104 @@ public:
 
 class TransformBric: public virtual ProcessingBric, public virtual SyncedInputBric, public BricImpl {
 protected:
+	std::vector<TransformBric*> m_fusedBrics;
+
 	bool nextExecStepImpl() override {
 		bool producedOutput = false;
 
-		if (allDestsReadyForInput()) {
-			if (allSourcesAvailable()) {
-				consumeInput();
-				tryProcessInput();
+		if (allDestsReadyForInput() && allSourcesAvailable()) {
+			consumeInput();
+			tryProcessInput();
+			if (hasDests()) announceNewOutput();
+			producedOutput = true;
+		}
+
+		// Input isn't needed anymore after processing, so sources can go on
+		// while the dests are still busy with the output:
+		announceReadyForInput();
+
+		// Input may still be pending if the dests weren't ready:
+		if (allSourcesFinished() && (nSourcesAvailable() == 0)) setExecFinished();
+
+		return producedOutput || execFinished();
+	}
+
+public:
+	// Whether nextExecStep would change the state of the bric. Brics for
+	// which this is false don't need to be executed.
+	virtual bool canMakeProgress() const final {
+		return !execFinished() && (
+			(allDestsReadyForInput() && allSourcesAvailable()) ||
+			(allSourcesFinished() && (nSourcesAvailable() == 0))
+		);
+	}
+
+	// Fuses a linear chain of transform brics into this one, each bric in
+	// brics must be the single dest of the previous one (starting with this
+	// bric) and have it as its single source. The fused brics must only be
+	// executed via nextFusedExecStep of this bric.
+	virtual void fuse(std::vector<TransformBric*> brics) final { m_fusedBrics = std::move(brics); }
+
+	virtual const std::vector<TransformBric*>& fusedBrics() const final { return m_fusedBrics; }
+
+	virtual bool fusedCanMakeProgress() const final;
+
+	void resetExec() override {
+		SyncedInputBric::resetExec();
+		// Fused brics are not known to the scheduler, so reset them here:
+		for (TransformBric *bric: m_fusedBrics) bric->resetExec();
+	}
+
+	// If all brics in the chain are idle, processes the input of this bric
+	// through the whole chain directly, without announcing intermediate
+	// outputs. Otherwise, executes the brics of the chain one by one.
+	bool nextFusedExecStep() final override;
+
+	bool fusedExecFinished() const final override
+		{ return m_fusedBrics.empty() ? execFinished() : m_fusedBrics.back()->execFinished(); }
+
+	using BricImpl::BricImpl;
+};
+
+
+
+// Like a transform bric, but only produces output for inputs selected by
+// filterInput. Dests are not executed for rejected inputs, which is
+// equivalent to a mapper producing no output for them. So every value a
+// dest of the filter (or any bric further downstream) needs has to pass
+// through the outputs of the filter: Brics with inputs both from the
+// filter and from unfiltered brics upstream of it are rejected by MRBric.
+class FilterBric: public virtual ProcessingBric, public virtual SyncedInputBric, public BricImpl {
+protected:
+	bool m_inputSelected = false;
+
+	bool nextExecStepImpl() override {
+		bool producedOutput = false;
+
+		if (allDestsReadyForInput() && allSourcesAvailable()) {
+			consumeInput();
+			m_inputSelected = false;
+			tryProcessInput();
+			if (m_inputSelected) {
 				if (hasDests()) announceNewOutput();
-				else announceReadyForInput();
 				producedOutput = true;
-			} else {
-				announceReadyForInput();
 			}
 		}
 
-		if (allSourcesFinished()) setExecFinished();
+		announceReadyForInput();
+
+		if (allSourcesFinished() && (nSourcesAvailable() == 0)) setExecFinished();
 
 		return producedOutput || execFinished();
 	}
 
 public:
+	// User overload. Returns true if the input is selected, outputs are only
+	// passed on to the dests in that case. Allowed to change output values.
+	virtual bool filterInput() = 0;
+
+	void processInput() final override { m_inputSelected = filterInput(); }
+
 	using BricImpl::BricImpl;
 };
 
@@ -875,40 +1182,88 @@ public:
 
 class MapperBric: public virtual ProcessingBric, public virtual SyncedInputBric, public BricImpl {
 protected:
+	class Pipeline;
+
 	bool m_readyForNextOutput = false;
+	bool m_producingFinalOutputs = false;
+
+	// Pipeline is incomplete here, so it needs an out-of-line deleter:
+	struct PipelineDeleter { void operator()(Pipeline *pipeline) const; };
+
+	std::unique_ptr<Pipeline, PipelineDeleter> m_pipeline;
+
+	static void collectOutputs(Bric &bric, std::vector<OutputTerminal*> &outputs);
+	static void redirectInputs(Bric &bric, const Value &from, const Value &to);
+
+	virtual void initPipeline() final;
+
+	// Stops the current pipeline job and joins the pipeline thread, which
+	// calls processInput, nextOutput and nextFinalOutput. Called when
+	// execution finishes or is reset, so the thread never outlives a run.
+	virtual void stopPipeline() final;
+
+	void initRecursive() override;
+
+	void resetExec() override;
+
+	virtual bool pipelinedNextExecStep() final;
 
 	bool nextExecStepImpl() override {
+		if (m_pipeline != nullptr) return pipelinedNextExecStep();
+
 		bool producedOutput = false;
 
 		if (allDestsReadyForInput()) {
-			if (! m_readyForNextOutput) {
-				if (allSourcesAvailable()) {
-					consumeInput();
-					tryProcessInput();
-					m_readyForNextOutput = true;
-				} else {
-					announceReadyForInput();
+			if (! m_producingFinalOutputs) {
+				if (! m_readyForNextOutput) {
+					if (allSourcesAvailable()) {
+						consumeInput();
+						tryProcessInput();
+						m_readyForNextOutput = true;
+					} else {
+						announceReadyForInput();
+					}
+				}
+
+				if (m_readyForNextOutput) {
+					try {
+						ExecProfile::Timer timer(m_execProfile, ExecProfile::Section::NEXT_OUTPUT);
+						producedOutput = nextOutput();
+					}
+					catch(const std::exception &e) {
+						dbrx_log_error("Producing next output failed in bric \"%s\": %s", absolutePath(), e.what());
+						setOutputsToErrorState();
+					}
+
+					if (producedOutput) {
+						if (hasDests()) announceNewOutput();
+						else announceReadyForInput();
+						m_readyForNextOutput = true;
+					} else {
+						announceReadyForInput();
+						m_readyForNextOutput = false;
+					}
 				}
 			}
 
-			if (m_readyForNextOutput) {
-				try{ producedOutput = nextOutput(); }
+			if (!producedOutput && allSourcesFinished()) {
+				// All input processed, give bric a chance to flush buffered data
+				m_producingFinalOutputs = true;
+				try {
+					ExecProfile::Timer timer(m_execProfile, ExecProfile::Section::NEXT_OUTPUT);
+					producedOutput = nextFinalOutput();
+				}
 				catch(const std::exception &e) {
-					dbrx_log_error("Producing next output failed in bric \"%s\": %s", absolutePath(), e.what());
+					dbrx_log_error("Producing final output failed in bric \"%s\": %s", absolutePath(), e.what());
 					setOutputsToErrorState();
 				}
 
 				if (producedOutput) {
 					if (hasDests()) announceNewOutput();
-					else announceReadyForInput();
-					m_readyForNextOutput = true;
 				} else {
-					announceReadyForInput();
-					m_readyForNextOutput = false;
+					setExecFinished();
 				}
 			}
-
-			if (!producedOutput && allSourcesFinished()) setExecFinished();
 		}
 
 		return producedOutput || execFinished();
@@ -918,7 +1273,33 @@ public:
 	// User overload. Allowed to change output values.
 	virtual bool nextOutput() = 0;
 
+	// User overload, called repeatedly after all sources have finished
+	// and all input has been processed, until it returns false. Allows
+	// to produce outputs from buffered data. Allowed to change output values.
+	virtual bool nextFinalOutput() { return false; }
+
+	// If pipelineDepth > 0, processInput, nextOutput and nextFinalOutput are
+	// run on a separate thread. Up to pipelineDepth outputs are buffered,
+	// so the bric can run ahead of it's dests. Requires copy-assignable
+	// output types. Outputs of inner brics (e.g. output groups) are buffered
+	// as well.
+	Param<int32_t> pipelineDepth{this, "pipelineDepth", "Number of outputs to produce ahead of dests on a separate thread (0 to disable)", 0};
+
+	// Whether nextOutput and nextFinalOutput completely rewrite output (an
+	// output of this bric or of an inner bric) and swapping it's content is
+	// cheap. The pipeline then swaps the output content into it's buffers
+	// instead of copying it, so the bric sees older buffer content in the
+	// output afterwards. Content addresses don't change.
+	virtual bool pipelineCanSwapOutput(const OutputTerminal &output) const { return false; }
+
+	// Restrict the outputs produced for each input to partition partIdx of
+	// nParts (e.g. a sub-range of entries), for data-parallel execution.
+	// Returns false if the bric doesn't support partitioning.
+	virtual bool setPartition(size_t partIdx, size_t nParts) { return false; }
+
 	using BricImpl::BricImpl;
+
+	~MapperBric() override;
 };
 
 
@@ -926,9 +1307,11 @@ public:
 class AbstractReducerBric: public virtual ProcessingBric {
 protected:
 	bool m_reductionStarted = false;
+	bool m_partialReduction = false;
 
 	virtual void beginReduction() final {
 		try {
+			ExecProfile::Timer timer(m_execProfile, ExecProfile::Section::NEW_REDUCTION);
 			newReduction();
 		}
 		catch(const std::exception &e) {
@@ -943,7 +1326,10 @@ protected:
 	virtual bool reductionStarted() const final { return m_reductionStarted; }
 
 	virtual void endReduction() final {
-		try { finalizeReduction(); }
+		try {
+			ExecProfile::Timer timer(m_execProfile, ExecProfile::Section::FINALIZE_REDUCTION);
+			finalizeReduction();
+		}
 		catch(const std::exception &e) {
 			dbrx_log_error("Finalization of reduction failed in bric \"%s\": %s", absolutePath(), e.what());
 			setOutputsToErrorState();
@@ -960,6 +1346,19 @@ public:
 
 	// User overload. Allowed to change output values.
 	virtual void finalizeReduction() {}
+
+	// A partial reduction only produces a result to be merged into another
+	// instance of the bric (see mergeReduction). Side effects, like writing
+	// output files, are left to the bric the result is merged into.
+	virtual bool partialReduction() const final { return m_partialReduction; }
+	virtual void partialReduction(bool partial) final { m_partialReduction = partial; }
+
+	// User overload, merges the finalized result of another instance of the
+	// same bric (processing a different part of the input) into the result
+	// of this one. Allowed to change output values.
+	virtual void mergeReduction(const AbstractReducerBric &other) {
+		throw std::runtime_error("Bric \"%s\" doesn't support merging of reduction results"_format(absolutePath()));
+	}
 };
 
 
@@ -1001,12 +1400,14 @@ public:
 class AsyncReducerBric: public virtual AbstractReducerBric, public virtual AsyncInputBric, public BricImpl {
 protected:
 	std::vector<size_t> m_inputCounter;
+	std::vector<size_t> m_availCounter;
 
 	void resetExec() override {
 		ProcessingBric::resetExec();
 		m_reductionStarted = false;
 		m_inputCounter.clear();
 		m_inputCounter.resize(m_sources.size());
+		m_availCounter.resize(m_sources.size());
 	}
 
 	bool nextExecStepImpl() override {
@@ -1020,12 +1421,16 @@ protected:
 
 			bool gotSiblingInput = false;
 			if (anySourceAvailable()) {
+				// Sources may announce new output concurrently, only
+				// acknowledge output that was available before processing:
+				for (size_t i = 0; i < m_sources.size(); ++i)
+					m_availCounter[i] = outputCounterOn(*m_sources[i]);
 				tryProcessInput();
 				for (size_t i = 0; i < m_sources.size(); ++i) {
 					auto &source = m_sources[i];
-					if (m_inputCounter[i] < source->m_outputCounter) {
+					if (m_inputCounter[i] < m_availCounter[i]) {
 						decNSourcesAvailable();
-						m_inputCounter[i] = source->m_outputCounter;
+						m_inputCounter[i] = m_availCounter[i];
 						source->incNDestsReadyForInput();
 						gotSiblingInput = true;
 					}
@@ -0,0 +1,95 @@
+// Copyright (C) 2014 Oliver Schulz <oschulz@mpp.mpg.de>
+
+// This is free software; you can redistribute it and/or modify it under
+// the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation; either version 2.1 of the License, or
+// (at your option) any later version.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+
+
+#ifndef DBRX_COW_H
+#define DBRX_COW_H
+
+#include <memory>
+#include <utility>
+
+
+namespace dbrx {
+
+
+/// @brief Copy-on-write value.
+///
+/// Copies of a Cow share the same content, it is only copied when a
+/// shared content is mutated. Use as terminal value type (e.g.
+/// Output<Cow<std::vector<float>>>) for large content that is passed to
+/// many consumers, so consumers that need a private (mutable) version of
+/// the content can keep a copy of the Cow and only pay for copying the
+/// content if they actually modify it.
+///
+/// Sharing is thread-safe, but a single Cow object must not be mutated
+/// while it is being copied.
+
+template<typename T> class Cow {
+protected:
+	std::shared_ptr<const T> m_content;
+
+public:
+	bool empty() const { return m_content == nullptr; }
+
+	// Whether the content is shared with other Cow objects
+	bool shared() const { return m_content.use_count() > 1; }
+
+	const T& get() const { return *m_content; }
+
+	const T* operator->() const { return m_content.get(); }
+	const T& operator*() const { return *m_content; }
+
+	// Returns the content for modification. Shared content is copied
+	// first, empty content is default-constructed.
+	T& mutate() {
+		if (empty()) m_content = std::make_shared<T>();
+		else if (shared()) m_content = std::make_shared<T>(*m_content);
+		return const_cast<T&>(*m_content);
+	}
+
+	Cow<T>& operator=(const T &content) {
+		if (!empty() && !shared()) const_cast<T&>(*m_content) = content;
+		else m_content = std::make_shared<T>(content);
+		return *this;
+	}
+
+	Cow<T>& operator=(T &&content) {
+		if (!empty() && !shared()) const_cast<T&>(*m_content) = std::move(content);
+		else m_content = std::make_shared<T>(std::move(content));
+		return *this;
+	}
+
+	Cow<T>& operator=(const Cow<T> &other) = default;
+	Cow<T>& operator=(Cow<T> &&other) = default;
+
+	Cow() {}
+
+	Cow(const Cow<T> &other) = default;
+	Cow(Cow<T> &&other) = default;
+
+	Cow(const T &content): m_content(std::make_shared<T>(content)) {}
+	Cow(T &&content): m_content(std::make_shared<T>(std::move(content))) {}
+
+	friend bool operator==(const Cow<T> &a, const Cow<T> &b)
+		{ return (a.m_content == b.m_content) || (!a.empty() && !b.empty() && (a.get() == b.get())); }
+
+	friend void swap(Cow<T> &a, Cow<T> &b) { std::swap(a.m_content, b.m_content); }
+};
+
+
+} // namespace dbrx
+
+#endif // DBRX_COW_H
@@ -0,0 +1,84 @@
+// Copyright (C) 2014 Oliver Schulz <oschulz@mpp.mpg.de>
+
+// This is free software; you can redistribute it and/or modify it under
+// the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation; either version 2.1 of the License, or
+// (at your option) any later version.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+
+
+
+#include "ExecProfile.h"
+
+#include <cassert>
+#include <chrono>
+#include <ctime>
+
+
+using namespace std;
+
+
+namespace dbrx {
+
+
+bool ExecProfile::s_enabled = false;
+
+
+const char* ExecProfile::sectionName(Section section) {
+	switch (section) {
+		case Section::EXEC_STEP: return "nextExecStep";
+		case Section::PROCESS_INPUT: return "processInput";
+		case Section::NEXT_OUTPUT: return "nextOutput";
+		case Section::IMPORT: return "import";
+		case Section::NEW_REDUCTION: return "newReduction";
+		case Section::FINALIZE_REDUCTION: return "finalizeReduction";
+		default: assert(false); return "";
+	}
+}
+
+
+int64_t ExecProfile::wallClockNow() {
+	using namespace chrono;
+	return duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+
+int64_t ExecProfile::cpuClockNow() {
+	timespec t;
+	if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &t) != 0) return 0;
+	return int64_t(t.tv_sec) * 1000000000 + int64_t(t.tv_nsec);
+}
+
+
+void ExecProfile::clear() {
+	m_counters.fill(Counters());
+	m_nOutputs = 0;
+}
+
+
+PropVal ExecProfile::toPropVal() const {
+	Props props;
+	props["outputs"] = int64_t(m_nOutputs);
+	for (size_t i = 0; i < nSections; ++i) {
+		const Counters &c = m_counters[i];
+		if (c.calls > 0) {
+			Props sectionProps;
+			sectionProps["calls"] = int64_t(c.calls);
+			sectionProps["wallTime"] = double(c.wallTime) * 1e-9;
+			sectionProps["cpuTime"] = double(c.cpuTime) * 1e-9;
+			props[sectionName(Section(i))] = PropVal(std::move(sectionProps));
+		}
+	}
+	return PropVal(std::move(props));
+}
+
+
+} // namespace dbrx
@@ -0,0 +1,117 @@
+// Copyright (C) 2014 Oliver Schulz <oschulz@mpp.mpg.de>
+
+// This is free software; you can redistribute it and/or modify it under
+// the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation; either version 2.1 of the License, or
+// (at your option) any later version.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+
+
+
+#ifndef DBRX_EXECPROFILE_H
+#define DBRX_EXECPROFILE_H
+
+#include <array>
+#include <cstdint>
+
+#include "Props.h"
+
+
+namespace dbrx {
+
+
+// Execution profile of a bric: Number of calls, wall-clock time and CPU time
+// (of the calling thread) for the bric's execution steps and user overloads,
+// and number of outputs produced. Only collected while profiling is enabled,
+// the overhead is a single check of a flag otherwise.
+
+class ExecProfile final {
+public:
+	enum class Section: int32_t {
+		EXEC_STEP = 0,
+		PROCESS_INPUT = 1,
+		NEXT_OUTPUT = 2,
+		IMPORT = 3,
+		NEW_REDUCTION = 4,
+		FINALIZE_REDUCTION = 5
+	};
+
+	static constexpr size_t nSections = 6;
+
+	struct Counters {
+		uint64_t calls = 0;
+		int64_t wallTime = 0; // in ns
+		int64_t cpuTime = 0; // in ns
+	};
+
+
+	// Adds the time between construction and destruction to a section
+	class Timer final {
+	protected:
+		Counters *m_counters = nullptr;
+		int64_t m_wallStart = 0;
+		int64_t m_cpuStart = 0;
+
+	public:
+		Timer(ExecProfile &profile, Section section) {
+			if (enabled()) {
+				m_counters = &profile.counters(section);
+				m_wallStart = wallClockNow();
+				m_cpuStart = cpuClockNow();
+			}
+		}
+
+		Timer(const Timer &other) = delete;
+		Timer& operator=(const Timer &other) = delete;
+
+		~Timer() {
+			if (m_counters != nullptr) {
+				++m_counters->calls;
+				m_counters->wallTime += wallClockNow() - m_wallStart;
+				m_counters->cpuTime += cpuClockNow() - m_cpuStart;
+			}
+		}
+	};
+
+protected:
+	static bool s_enabled;
+
+	std::array<Counters, nSections> m_counters;
+	uint64_t m_nOutputs = 0;
+
+public:
+	static bool enabled() { return s_enabled; }
+	static void enabled(bool enable) { s_enabled = enable; }
+
+	static const char* sectionName(Section section);
+
+	// Monotonic wall-clock time in ns
+	static int64_t wallClockNow();
+
+	// CPU time of the calling thread in ns
+	static int64_t cpuClockNow();
+
+	Counters& counters(Section section) { return m_counters[size_t(section)]; }
+	const Counters& counters(Section section) const { return m_counters[size_t(section)]; }
+
+	void countOutput() { if (enabled()) ++m_nOutputs; }
+	uint64_t nOutputs() const { return m_nOutputs; }
+
+	void clear();
+
+	// Sections without any calls are omitted, times are in seconds
+	PropVal toPropVal() const;
+};
+
+
+} // namespace dbrx
+
+#endif // DBRX_EXECPROFILE_H
@@ -18,6 +18,9 @@
 #include "MRBric.h"
 
 #include <iostream>
+#include <algorithm>
+#include <functional>
+#include <unordered_set>
 
 #include "format.h"
 #include "funcprog.h"
@@ -29,6 +32,10 @@ using namespace std;
 namespace dbrx {
 
 
+size_t MRBric::s_defaultNThreads = 1;
+std::string MRBric::s_defaultScheduler = "layers";
+
+
 std::unordered_map<Bric*, size_t> MRBric::calcBricGraphLayers(const std::vector<Bric*> &brics) {
 	// Translation between bric lingo and graph lingo
 
@@ -129,10 +136,146 @@ std::unordered_map<Bric*, size_t> MRBric::calcBricGraphLayers(const std::vector<
 }
 
 
-void MRBric::init() {
+std::vector<Bric*> MRBric::innerExecBrics() {
 	std::vector<Bric*> execBrics;
 	execBrics.reserve(m_brics.size());
 	for (auto &entry: m_brics) execBrics.push_back(entry.second);
+	return execBrics;
+}
+
+
+void MRBric::collectOutputs(Bric &bric, std::vector<OutputTerminal*> &outputs) {
+	for (const auto &entry: bric.outputs()) outputs.push_back(entry.second);
+	for (const auto &entry: bric.m_brics) {
+		if (dynamic_cast<TerminalGroup*>(entry.second) != nullptr)
+			collectOutputs(*entry.second, outputs);
+	}
+}
+
+
+std::vector<Bric::OutputTerminal*> MRBric::referencedOutputs(const PropVal &refs) {
+	vector<OutputTerminal*> outputs;
+	if (refs.isNone()) return outputs;
+	for (const auto pv: refs) {
+		PropPath path(BCReference(pv).path());
+		BricComponent &component = getComponent(PropPath::Fragment(path));
+		if (dynamic_cast<OutputTerminal*>(&component) != nullptr)
+			outputs.push_back(dynamic_cast<OutputTerminal*>(&component));
+		else if (dynamic_cast<Bric*>(&component) != nullptr)
+			collectOutputs(dynamic_cast<Bric&>(component), outputs);
+		else throw invalid_argument("\"%s\" in bric \"%s\" is neither an output nor a bric"_format(path, absolutePath()));
+	}
+	return outputs;
+}
+
+
+void MRBric::applyAfterUseConfig() {
+	using AfterUse = OutputTerminal::AfterUse;
+	for (OutputTerminal *output: referencedOutputs(resetAfterUse)) output->afterUse(AfterUse::RESET);
+	for (OutputTerminal *output: referencedOutputs(releaseAfterUse)) output->afterUse(AfterUse::RELEASE);
+}
+
+
+void MRBric::applyRecyclingConfig() {
+	if (nRecycled < 0) throw invalid_argument("Invalid number of recycled objects %s for bric \"%s\""_format(nRecycled.get(), absolutePath()));
+	for (OutputTerminal *output: referencedOutputs(recycleOutputs)) {
+		auto value = dynamic_cast<PrimaryValue*>(&output->value());
+		if (value != nullptr) {
+			dbrx_log_debug("Keeping up to %s content objects of output \"%s\" for reuse", nRecycled.get(), output->absolutePath());
+			value->maxRecycled(size_t(nRecycled));
+		}
+	}
+}
+
+
+void MRBric::analyseOutputLifetimes(const std::vector<Bric*> &execBrics) {
+	for (Bric *bric: execBrics) {
+		bric->m_outputsToRelease.clear();
+
+		vector<OutputTerminal*> outputs;
+		collectOutputs(*bric, outputs);
+
+		for (OutputTerminal *output: outputs) {
+			if (output->afterUse() == OutputTerminal::AfterUse::KEEP) continue;
+
+			// The value may only go away when the dests of bric announce
+			// they're ready for new input, so all consumers must be inputs of
+			// (or inside) it's dests. Pipelined mappers pass copies of their
+			// outputs to the dests, reducer results may still be merged.
+			const char *reason = nullptr;
+			if (output->consumers().empty()) reason = "output has no consumers";
+			else if (dynamic_cast<AbstractReducerBric*>(bric) != nullptr) reason = "reduction results may be merged";
+			else if ((dynamic_cast<MapperBric*>(bric) != nullptr) && (dynamic_cast<MapperBric*>(bric)->pipelineDepth > 0)) reason = "bric is pipelined";
+			else for (const InputTerminal *consumer: output->consumers()) {
+				if (consumer->effSrcBric() != bric) { reason = "output is used outside of the dests of it's bric"; break; }
+			}
+
+			if (reason == nullptr) {
+				dbrx_log_debug("Output \"%s\" will be %s after use by all dests", output->absolutePath(),
+					(output->afterUse() == OutputTerminal::AfterUse::RELEASE) ? "released" : "reset");
+				bric->m_outputsToRelease.push_back(output);
+			} else {
+				dbrx_log_debug("Keeping output \"%s\" after use, %s", output->absolutePath(), reason);
+			}
+		}
+	}
+}
+
+
+void MRBric::checkFilterDests(const std::vector<Bric*> &execBrics) {
+	unordered_set<Bric*> inner(execBrics.begin(), execBrics.end());
+
+	// Inner brics upstream of each inner bric:
+	unordered_map<Bric*, unordered_set<Bric*>> upstream;
+	std::function<const unordered_set<Bric*>& (Bric*)> getUpstream = [&](Bric *bric) -> const unordered_set<Bric*>& {
+		auto found = upstream.find(bric);
+		if (found != upstream.end()) return found->second;
+		unordered_set<Bric*> up;
+		for (Bric *source: bric->sources()) {
+			if (inner.find(source) == inner.end()) continue;
+			const unordered_set<Bric*> &sourceUp = getUpstream(source);
+			up.insert(source);
+			up.insert(sourceUp.begin(), sourceUp.end());
+		}
+		return upstream[bric] = std::move(up);
+	};
+
+	for (Bric *filter: execBrics) {
+		if (dynamic_cast<FilterBric*>(filter) == nullptr) continue;
+		const unordered_set<Bric*> &filterUp = getUpstream(filter);
+
+		for (Bric *dest: execBrics) {
+			if (dynamic_cast<SyncedInputBric*>(dest) == nullptr) continue;
+
+			Bric *filtered = nullptr;
+			Bric *unfiltered = nullptr;
+			for (Bric *source: dest->sources()) {
+				if (inner.find(source) == inner.end()) continue;
+				const unordered_set<Bric*> &sourceUp = getUpstream(source);
+				if ((source == filter) || (sourceUp.find(filter) != sourceUp.end())) {
+					filtered = source;
+				} else if (
+					(filterUp.find(source) != filterUp.end()) ||
+					any_of(sourceUp.begin(), sourceUp.end(), [&](Bric *b) { return filterUp.find(b) != filterUp.end(); })
+				) {
+					unfiltered = source;
+				}
+			}
+
+			if ((filtered != nullptr) && (unfiltered != nullptr)) {
+				throw invalid_argument("Bric \"%s\" gets input both through filter bric \"%s\" (from \"%s\") and from unfiltered bric \"%s\", it would block on inputs rejected by the filter. Pass all values needed downstream of the filter through outputs of the filter."_format(
+					dest->absolutePath(), filter->absolutePath(), filtered->absolutePath(), unfiltered->absolutePath()
+				));
+			}
+		}
+	}
+}
+
+
+void MRBric::init() {
+	std::vector<Bric*> execBrics = innerExecBrics();
+
+	checkFilterDests(execBrics);
 
 	dbrx_log_debug("Initializing processing layers for bric \"%s\"", absolutePath());
 	clear();
@@ -152,61 +295,170 @@ void MRBric::init() {
 	for (Bric *bric: execBrics) m_execLayers.at(gLayers.at(bric)).brics.push_back(bric);
 	for (auto& layer: m_execLayers) sortBricsByName(layer.brics);
 
+	for (Bric *bric: execBrics) {
+		bric->fusedHead(nullptr);
+		auto transform = dynamic_cast<TransformBric*>(bric);
+		if (transform != nullptr) transform->fuse({});
+	}
+	fuseTransformChains();
+
+	for (auto& layer: m_execLayers) layer.compileStatic();
+
+	applyAfterUseConfig();
+	applyRecyclingConfig();
+	analyseOutputLifetimes(execBrics);
+
 	for (size_t i = 0; i < m_execLayers.size(); ++i) {
-		dbrx_log_debug("Exec layer %s: %s"_format(
-			i,
+		dbrx_log_debug("Exec layer %s (%s): %s"_format(
+			i, m_execLayers[i].isStatic() ? "static" : "dynamic",
 			mkstring(mapped(m_execLayers[i].brics, [&](Bric* bric){ return bric->name(); }), ", ")
 		));
 	}
 
+	const string &schedName = scheduler.get().empty() ? defaultScheduler() : scheduler.get();
+	if (schedName == "layers") m_schedulerType = SchedulerType::LAYERS;
+	else if (schedName == "readyQueue") m_schedulerType = SchedulerType::READY_QUEUE;
+	else if (schedName == "workStealing") m_schedulerType = SchedulerType::WORK_STEALING;
+	else throw invalid_argument("Invalid scheduler \"%s\" for bric \"%s\""_format(schedName, absolutePath()));
+
+	if (nThreads < 0) throw invalid_argument("Invalid number of threads %s for bric \"%s\""_format(nThreads.get(), absolutePath()));
+	size_t nExecThreads = (nThreads > 0) ? size_t(nThreads) : defaultInnerNThreads();
+
+	if (m_schedulerType == SchedulerType::WORK_STEALING) {
+		nExecThreads = max(min(nExecThreads, execBrics.size()), size_t(1));
+		dbrx_log_debug("Using work-stealing executor with %s threads for inner brics of bric \"%s\"", nExecThreads, absolutePath());
+		if (nExecThreads > 1) enableConcurrentExec();
+		m_executor = unique_ptr<WorkStealingExecutor>(new WorkStealingExecutor(nExecThreads));
+		for (Bric *bric: execBrics) bric->scheduler(m_executor.get());
+		resetExec();
+		return;
+	}
+
+	for (Bric *bric: execBrics) bric->scheduler((m_schedulerType == SchedulerType::READY_QUEUE) ? &m_readyQueue : nullptr);
+
+	size_t maxLayerSize = 0;
+	for (const auto& layer: m_execLayers) maxLayerSize = max(maxLayerSize, layer.brics.size());
+	nExecThreads = min(nExecThreads, maxLayerSize);
+	if (m_schedulerType == SchedulerType::READY_QUEUE) nExecThreads = 1;
+
+	if (nExecThreads > 1) {
+		dbrx_log_debug("Using %s threads to execute inner brics of bric \"%s\"", nExecThreads, absolutePath());
+		enableConcurrentExec();
+		m_threadPool = unique_ptr<ThreadPool>(new ThreadPool(nExecThreads));
+		for (auto& layer: m_execLayers) layer.prepareConcurrentExec();
+	}
+
 	resetExec();
 }
 
 
+void MRBric::fuseTransformChains() {
+	unordered_set<Bric*> layerBrics;
+	for (const auto &layer: m_execLayers) layerBrics.insert(layer.brics.begin(), layer.brics.end());
+
+	// Layers are in topological order, so chain heads are visited first
+	unordered_set<Bric*> fusedBrics;
+	for (const auto &layer: m_execLayers) {
+		for (Bric *bric: layer.brics) {
+			auto head = dynamic_cast<TransformBric*>(bric);
+			if ((head == nullptr) || (fusedBrics.find(bric) != fusedBrics.end())) continue;
+
+			vector<TransformBric*> chain;
+			TransformBric *last = head;
+			while (last->dests().size() == 1) {
+				auto next = dynamic_cast<TransformBric*>(last->dests().front());
+				if (
+					(next == nullptr) || (layerBrics.find(next) == layerBrics.end()) ||
+					(next->sources().size() != 1) ||
+					(next->canRunConcurrently() != head->canRunConcurrently())
+				) break;
+				chain.push_back(next);
+				last = next;
+			}
+
+			if (!chain.empty()) {
+				dbrx_log_debug("Fusing transform bric chain %s -> %s in bric \"%s\"",
+					head->name(), mkstring(mapped(chain, [&](TransformBric* b){ return b->name(); }), " -> "), absolutePath());
+				for (TransformBric *member: chain) {
+					member->fusedHead(head);
+					fusedBrics.insert(member);
+				}
+				head->fuse(std::move(chain));
+			}
+		}
+	}
+
+	for (auto &layer: m_execLayers) {
+		layer.brics.erase(
+			remove_if(layer.brics.begin(), layer.brics.end(), [&](Bric *bric) { return fusedBrics.find(bric) != fusedBrics.end(); }),
+			layer.brics.end()
+		);
+	}
+	m_execLayers.erase(
+		remove_if(m_execLayers.begin(), m_execLayers.end(), [](const ExecLayer &layer) { return layer.brics.empty(); }),
+		m_execLayers.end()
+	);
+}
+
+
+bool MRBric::execCurrentLayer(bool walkingUp) {
+	// Walking up, brics in static layers only produce output for input that
+	// is still pending (because their dests weren't ready), so only brics
+	// with pending input or that still have to finish need to be executed:
+	bool execResult = (walkingUp && m_currentLayer->isStatic()) ?
+		m_currentLayer->pollExecStep() :
+		m_currentLayer->nextExecStep(m_threadPool.get());
+	dbrx_log_trace("Exec result for exec layer %s: %s", currentLayerNo(), execResult);
+
+	if (m_currentLayer->execFinished()) m_topLayer = m_currentLayer;
+
+	return execResult;
+}
+
+
 bool MRBric::processingStep() {
 	assert(m_currentLayer >= m_topLayer); // Sanity check
 	assert(m_currentLayer <= m_bottomLayer); // Sanity check
 
 	if (!m_innerExecFinished) {
-		bool execResult = m_currentLayer->nextExecStep();
-		dbrx_log_trace("Exec result for current exec layer: %s", execResult);
-
-		if (m_currentLayer->execFinished()) m_topLayer = m_currentLayer;
+		// Sweep down to the bottom layer:
+		while (true) {
+			execCurrentLayer(false);
+			if (m_currentLayer == m_bottomLayer) break;
+			moveDownOneLayer();
+		}
 
-		if (m_currentLayer == m_bottomLayer) {
-			m_runningDown = false;
-			if (m_currentLayer->execFinished()) {
-				dbrx_log_trace("Processing finished for bric \"%s\" (all inner brics in bottom exec layer finished)", absolutePath());
-				m_innerExecFinished = true;
-			} else {
-				if (m_currentLayer != m_topLayer) moveUpOneLayer();
-			}
+		if (m_bottomLayer->execFinished()) {
+			dbrx_log_trace("Processing finished for bric \"%s\" (all inner brics in bottom exec layer finished)", absolutePath());
+			m_innerExecFinished = true;
 		} else {
-			if (m_runningDown) {
-				moveDownOneLayer();
-			} else {
-				if (execResult) {
-					// Layer produced output or all brics in layer are finished
-					m_runningDown = true;
+			// Walk up to the first layer that produces output or is finished,
+			// the next sweep down starts below it:
+			while (m_currentLayer != m_topLayer) {
+				moveUpOneLayer();
+				if (execCurrentLayer(true)) {
 					moveDownOneLayer();
-				} else {
-					// No output from layer and layer not finished
-					m_runningDown = false;
-					if (m_currentLayer != m_topLayer) moveUpOneLayer();
-					else {
-						m_innerExecFinished = true;
-						throw std::logic_error("Internal error during processing of bric \"%s\", top exec layer has no output but is not finished"_format(absolutePath()));
-					} 
+					break;
+				} else if (m_currentLayer == m_topLayer) {
+					m_innerExecFinished = true;
+					throw std::logic_error("Internal error during processing of bric \"%s\", top exec layer has no output but is not finished"_format(absolutePath()));
 				}
 			}
-		} 
+		}
 	}
 	return m_innerExecFinished;
 }
 
 
+bool MRBric::canRunConcurrently() const {
+	for (const auto &entry: m_brics)
+		if (! entry.second->canRunConcurrently()) return false;
+	return true;
+}
+
+
 void MRBric::resetExec() {
-	SyncedInputBric::resetExec();
+	TransformBric::resetExec();
 	resetExecInner();
 }
 
@@ -219,16 +471,66 @@ void MRBric::resetExecInner() {
 		m_currentLayer = m_topLayer;
 		m_bottomLayer = m_execLayers.end() - 1;
 		m_innerExecFinished = false;
-		m_runningDown = true;
 		for (auto &layer: m_execLayers) layer.resetExec();
+
+		m_readyQueue.clear();
+		if (m_schedulerType == SchedulerType::READY_QUEUE) {
+			for (auto &layer: m_execLayers)
+				for (Bric *bric: layer.brics) m_readyQueue.push(bric);
+		}
 	} else {
 		m_innerExecFinished = true;
 	}
 }
 
 
+void MRBric::processReadyBrics() {
+	while (!m_readyQueue.empty()) {
+		Bric *bric = m_readyQueue.pop();
+		dbrx_log_trace("Executing ready bric \"%s\"", bric->absolutePath());
+		bool execResult = bric->nextFusedExecStep();
+		// Brics that produced output may be able to produce more without
+		// any changes in their sources or dests:
+		if (execResult && !bric->fusedExecFinished()) m_readyQueue.push(bric);
+	}
+
+	checkInnerExecFinished();
+}
+
+
+void MRBric::checkInnerExecFinished() {
+	for (const auto &layer: m_execLayers) {
+		for (const Bric *bric: layer.brics) {
+			if (!bric->fusedExecFinished()) {
+				m_innerExecFinished = true;
+				throw std::logic_error("Internal error during processing of bric \"%s\", no inner brics ready but bric \"%s\" is not finished"_format(absolutePath(), bric->absolutePath()));
+			}
+		}
+	}
+	dbrx_log_trace("Processing finished for bric \"%s\" (all inner brics finished)", absolutePath());
+	m_innerExecFinished = true;
+}
+
+
 void MRBric::processInput() {
-	while(!m_innerExecFinished) processingStep();
+	try {
+		if (m_schedulerType == SchedulerType::READY_QUEUE) {
+			if (!m_innerExecFinished) processReadyBrics();
+		} else if (m_schedulerType == SchedulerType::WORK_STEALING) {
+			if (!m_innerExecFinished) {
+				vector<Bric*> brics;
+				for (const auto &layer: m_execLayers) brics.insert(brics.end(), layer.brics.begin(), layer.brics.end());
+				m_executor->run(brics);
+				checkInnerExecFinished();
+			}
+		} else {
+			while(!m_innerExecFinished) processingStep();
+		}
+	} catch (...) {
+		// Stop inner brics (e.g. mapper pipeline threads) on abort:
+		resetExecInner();
+		throw;
+	}
 	resetExecInner();
 }
 
@@ -20,9 +20,12 @@
 
 #include <stdexcept>
 #include <unordered_map>
+#include <memory>
 
 #include "logging.h"
 #include "Bric.h"
+#include "ThreadPool.h"
+#include "WorkStealingExecutor.h"
 
 
 namespace dbrx {
@@ -34,6 +37,39 @@ protected:
 		std::vector<Bric*> brics;
 		bool m_execFinished = false;
 
+		// Static layers contain only transform brics, which produce exactly
+		// one output per input:
+		bool m_static = false;
+		std::vector<TransformBric*> m_staticBrics;
+
+		// For multi-threaded execution:
+		std::vector<Bric*> m_concurrentBrics;
+		std::vector<Bric*> m_sequentialBrics;
+		std::vector<uint8_t> m_execResults;
+
+		void prepareConcurrentExec() {
+			m_concurrentBrics.clear();
+			m_sequentialBrics.clear();
+			for (Bric *bric: brics) {
+				if (bric->canRunConcurrently()) m_concurrentBrics.push_back(bric);
+				else m_sequentialBrics.push_back(bric);
+			}
+			m_execResults.assign(m_concurrentBrics.size() + 1, true);
+		}
+
+		void compileStatic() {
+			m_static = true;
+			m_staticBrics.clear();
+			for (Bric *bric: brics) {
+				auto transform = dynamic_cast<TransformBric*>(bric);
+				if (transform != nullptr) m_staticBrics.push_back(transform);
+				else m_static = false;
+			}
+			if (!m_static) m_staticBrics.clear();
+		}
+
+		bool isStatic() const { return m_static; }
+
 		void resetExec() {
 			m_execFinished = false;
 			for (Bric *bric: brics) bric->resetExec();
@@ -41,14 +77,56 @@ protected:
 
 		bool execFinished() const { return m_execFinished; }
 
-		bool nextExecStep() {
+		static bool execBric(Bric *bric) {
+			dbrx_log_trace("Executing bric \"%s\"", bric->absolutePath());
+			return bric->nextFusedExecStep();
+		}
+
+		bool nextExecStep(ThreadPool *threadPool = nullptr) {
 			if (!m_execFinished) {
 				bool allBricExecsTrue = true;
 				bool allBricsFinished = true;
-				for (Bric* bric: brics) {
-					dbrx_log_trace("Executing bric \"%s\"", bric->absolutePath());
-					allBricExecsTrue &= bric->nextExecStep();
-					allBricsFinished &= bric->execFinished();
+
+				size_t nConcurrent = m_concurrentBrics.size();
+				size_t nTasks = nConcurrent + (m_sequentialBrics.empty() ? 0 : 1);
+
+				if ((threadPool != nullptr) && (nTasks > 1)) {
+					// Brics in the same layer are independent of each other,
+					// brics that can't run concurrently are executed
+					// sequentially as a single task.
+					threadPool->parallelFor(nTasks, [&](size_t i) {
+						if (i < nConcurrent) {
+							m_execResults[i] = execBric(m_concurrentBrics[i]);
+						} else {
+							bool result = true;
+							for (Bric* bric: m_sequentialBrics) result &= execBric(bric);
+							m_execResults[i] = result;
+						}
+					});
+					for (size_t i = 0; i < nTasks; ++i) allBricExecsTrue &= bool(m_execResults[i]);
+					for (Bric* bric: brics) allBricsFinished &= bric->fusedExecFinished();
+				} else {
+					for (Bric* bric: brics) {
+						allBricExecsTrue &= execBric(bric);
+						allBricsFinished &= bric->fusedExecFinished();
+					}
+				}
+
+				m_execFinished = allBricsFinished;
+				return allBricExecsTrue || m_execFinished;
+			} else return true;
+		}
+
+		// Same result as nextExecStep, for static layers. Only executes brics
+		// that can make progress, the others just get checked.
+		bool pollExecStep() {
+			if (!m_execFinished) {
+				bool allBricExecsTrue = true;
+				bool allBricsFinished = true;
+				for (TransformBric* bric: m_staticBrics) {
+					if (bric->fusedCanMakeProgress()) allBricExecsTrue &= execBric(bric);
+					else allBricExecsTrue &= bric->fusedExecFinished();
+					allBricsFinished &= bric->fusedExecFinished();
 				}
 				m_execFinished = allBricsFinished;
 				return allBricExecsTrue || m_execFinished;
@@ -57,6 +135,11 @@ protected:
 	};
 
 
+	enum class SchedulerType { LAYERS, READY_QUEUE, WORK_STEALING };
+
+	static size_t s_defaultNThreads;
+	static std::string s_defaultScheduler;
+
 	static std::unordered_map<Bric*, size_t> calcBricGraphLayers(const std::vector<Bric*> &brics);
 
 	static void sortBricsByName(std::vector<Bric*> &brics) {
@@ -66,10 +149,15 @@ protected:
 
 
 	bool m_innerExecFinished = false;
-	bool m_runningDown = true;
 
 	std::vector<ExecLayer> m_execLayers;
 
+	std::unique_ptr<ThreadPool> m_threadPool;
+
+	SchedulerType m_schedulerType = SchedulerType::LAYERS;
+	ReadyQueue m_readyQueue;
+	std::unique_ptr<WorkStealingExecutor> m_executor;
+
 	using LIter = decltype(m_execLayers.begin());
 	LIter m_topLayer;
 	LIter m_currentLayer;
@@ -88,20 +176,93 @@ protected:
 	}
 
 
+	virtual bool execCurrentLayer(bool walkingUp) final;
+
 	bool canHaveDynBrics() const override { return true; }
 
+	// Inner brics to be executed by the processing layers
+	virtual std::vector<Bric*> innerExecBrics();
+
+	// Fuses linear chains of transform brics in the exec layers, only the
+	// chain heads remain in the layers.
+	virtual void fuseTransformChains();
+
+	// Adds the outputs of bric and of it's inner terminal groups to outputs
+	static void collectOutputs(Bric &bric, std::vector<OutputTerminal*> &outputs);
+
+	// Inner outputs referenced by refs (references to brics select all of
+	// their outputs)
+	virtual std::vector<OutputTerminal*> referencedOutputs(const PropVal &refs);
+
+	// Sets the after-use policy of the inner outputs referenced by
+	// resetAfterUse and releaseAfterUse.
+	virtual void applyAfterUseConfig();
+
+	// Enables content recycling for the inner outputs referenced by
+	// recycleOutputs.
+	virtual void applyRecyclingConfig();
+
+	// Determines which inner outputs with an after-use policy can safely be
+	// reset/released once all dests of their bric have used them.
+	virtual void analyseOutputLifetimes(const std::vector<Bric*> &execBrics);
+
+	// Throws if a bric with synced inputs gets input both through a filter
+	// bric and from an unfiltered bric upstream of the filter (or sharing
+	// an upstream bric with it). It would wait for the filter's output on
+	// rejected inputs, while blocking the unfiltered source.
+	virtual void checkFilterDests(const std::vector<Bric*> &execBrics);
+
+	// Number of threads to use if nThreads is not set
+	virtual size_t defaultInnerNThreads() const { return defaultNThreads(); }
+
 	void init() override;
 
 	virtual bool processingStep() final;
 
+	// Alternative to processingStep, executes queued inner brics until all
+	// are finished
+	virtual void processReadyBrics() final;
+
+	virtual void checkInnerExecFinished() final;
+
 	virtual void resetExecInner();
 
 public:
+	// Default number of threads for MR brics that don't specify nThreads
+	static size_t defaultNThreads() { return s_defaultNThreads; }
+	static void defaultNThreads(size_t n) { s_defaultNThreads = n; }
+
+	// Default scheduler for MR brics that don't specify scheduler
+	static const std::string& defaultScheduler() { return s_defaultScheduler; }
+	static void defaultScheduler(const std::string &sched) { s_defaultScheduler = sched; }
+
+	Param<int32_t> nThreads{this, "nThreads", "Number of threads to use for executing independent inner brics (0 for default)", 0};
+
+	// "layers" executes inner brics layer by layer, "readyQueue" only
+	// executes brics that were notified of new input, readiness of their
+	// dests or finished sources (sequentially). "workStealing" executes
+	// notified brics on nThreads threads, without synchronizing layers.
+	Param<std::string> scheduler{this, "scheduler", "Inner bric scheduler (\"layers\", \"readyQueue\" or \"workStealing\", empty for default)", ""};
+
+	// References to inner outputs, or to inner brics for all their outputs,
+	// to reset (resp. release) after all dests have used them, to limit the
+	// number of large intermediate values alive at the same time. See
+	// Bric::OutputTerminal::AfterUse.
+	Param<PropVal> resetAfterUse{this, "resetAfterUse", "Inner outputs to reset to default values after use by all dests"};
+	Param<PropVal> releaseAfterUse{this, "releaseAfterUse", "Inner outputs to release after use by all dests"};
+
+	// References to inner outputs (or brics) that keep up to nRecycled
+	// replaced content objects for reuse, see PrimaryValue::maxRecycled.
+	Param<PropVal> recycleOutputs{this, "recycleOutputs", "Inner outputs to recycle content objects of"};
+	Param<int32_t> nRecycled{this, "nRecycled", "Number of content objects to keep for reuse per recycling output", 2};
+
+	bool canRunConcurrently() const override;
+
 	void resetExec() override;
 
 	void processInput() override;
 
-	virtual void clear() final { m_execLayers.clear(); }
+	virtual void clear() final { m_execLayers.clear(); m_threadPool.reset(); m_readyQueue.clear(); m_executor.reset(); }
 
 	virtual void run() final;
 
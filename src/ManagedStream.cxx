@@ -92,6 +92,19 @@ void ManagedOutputStream::open(const std::string& fileName) {
 }
 
 
+void ManagedOutputStream::openForAppend(const std::string& fileName) {
+	close();
+
+	if (isStdStreamName(fileName)) {
+		ownStdStream();
+		m_stream_ptr = stdStream();
+	} else {
+		m_stream_ptr = new ofstream(fileName.c_str(), ios_base::app);
+		m_owned_stream.reset(m_stream_ptr);
+	}
+}
+
+
 void ManagedOutputStream::close() {
 	m_stream_ptr = 0;
 	ManagedStream::close();
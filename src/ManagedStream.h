@@ -80,6 +80,7 @@ public:
 	std::ostream& stream() final override { return *m_stream_ptr; }
 
 	void open(const std::string& fileName) override;
+	virtual void openForAppend(const std::string& fileName);
 	void close() override;
 
 	ManagedOutputStream() = default;
@@ -0,0 +1,200 @@
+// Copyright (C) 2014 Oliver Schulz <oschulz@mpp.mpg.de>
+
+// This is free software; you can redistribute it and/or modify it under
+// the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation; either version 2.1 of the License, or
+// (at your option) any later version.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+
+
+
+#include "ParallelMRBric.h"
+
+#include <algorithm>
+
+#include "TypeReflection.h"
+
+
+using namespace std;
+
+
+namespace dbrx {
+
+
+bool ParallelMRBric::isReplica(const Bric *bric) const {
+	return find(m_replicas.begin(), m_replicas.end(), bric) != m_replicas.end();
+}
+
+
+void ParallelMRBric::removeReplicas() {
+	for (ParallelMRBric *replica: m_replicas) {
+		PropKey replicaName = replica->name();
+		m_dynBricClassNames.erase(replicaName);
+		m_dynBrics.erase(replicaName);
+	}
+	m_replicas.clear();
+}
+
+
+void ParallelMRBric::createReplicas() {
+	removeReplicas();
+
+	if (nReplicas < 0) throw invalid_argument("Invalid number of replicas %s for bric \"%s\""_format(nReplicas.get(), absolutePath()));
+	size_t nTotal = (nReplicas > 0) ? size_t(nReplicas) : defaultNThreads();
+
+	if ((nTotal > 1) && !MRBric::canRunConcurrently()) {
+		dbrx_log_warn("Inner brics of bric \"%s\" can't run concurrently, using a single replica", absolutePath());
+		nTotal = 1;
+	}
+
+	if (nTotal > 1) {
+		PropVal replicaConfig = getConfig();
+		replicaConfig[s_bricTypeKey] = TypeReflection(typeid(*this)).name();
+		replicaConfig[nReplicas.name()] = int32_t(1);
+		if (nThreads == 0) replicaConfig[nThreads.name()] = int32_t(1);
+
+		dbrx_log_debug("Creating %s replicas of inner bric graph of bric \"%s\"", nTotal - 1, absolutePath());
+		for (size_t i = 1; i < nTotal; ++i) {
+			PropKey replicaName = "replica%s"_format(i);
+			if (hasComponent(replicaName)) throw invalid_argument("Can't create replica \"%s\" in bric \"%s\", component name already in use"_format(replicaName, absolutePath()));
+			m_replicas.push_back(dynamic_cast<ParallelMRBric*>(addDynBric(replicaName, replicaConfig)));
+			assert(m_replicas.back() != nullptr);
+		}
+	}
+}
+
+
+unordered_set<const Bric*> ParallelMRBric::partitionMappers(size_t partIdx, size_t nParts) {
+	unordered_set<const Bric*> partitioned;
+	for (auto &entry: m_brics) {
+		auto mapper = dynamic_cast<MapperBric*>(entry.second);
+		if ((mapper != nullptr) && mapper->setPartition(partIdx, nParts)) {
+			dbrx_log_trace("Bric \"%s\" restricted to partition %s of %s", mapper->absolutePath(), partIdx, nParts);
+			partitioned.insert(mapper);
+		}
+	}
+	return partitioned;
+}
+
+
+bool ParallelMRBric::hasPartitionedSource(Bric *bric, const unordered_set<const Bric*> &partitioned) {
+	// Sources of inner brics are siblings inside this bric, external
+	// sources are sources of this bric itself:
+	for (Bric *source: bric->sources()) {
+		if ((partitioned.find(source) != partitioned.end()) || hasPartitionedSource(source, partitioned))
+			return true;
+	}
+	return false;
+}
+
+
+void ParallelMRBric::checkPartitioning(const unordered_set<const Bric*> &partitioned) {
+	if (partitioned.empty()) throw invalid_argument("Bric \"%s\" has %s replicas, but no inner bric that supports partitioning"_format(absolutePath(), m_replicas.size() + 1));
+
+	for (auto &entry: m_brics) {
+		auto mapper = dynamic_cast<MapperBric*>(entry.second);
+		if ((mapper != nullptr) && (partitioned.find(mapper) == partitioned.end()) && !hasPartitionedSource(mapper, partitioned)) {
+			throw invalid_argument("Mapper bric \"%s\" doesn't support partitioning and has no partitioned mapper upstream, it would produce all of its outputs in each of the %s replicas of bric \"%s\""_format(
+				mapper->absolutePath(), m_replicas.size() + 1, absolutePath()
+			));
+		}
+	}
+}
+
+
+void ParallelMRBric::setPartialReductions(bool partial) {
+	for (auto &entry: m_brics) {
+		auto reducer = dynamic_cast<AbstractReducerBric*>(entry.second);
+		if (reducer != nullptr) reducer->partialReduction(partial);
+	}
+}
+
+
+void ParallelMRBric::mergeReplicaResults() {
+	for (ParallelMRBric *replica: m_replicas) {
+		for (auto &entry: m_brics) {
+			auto reducer = dynamic_cast<AbstractReducerBric*>(entry.second);
+			if (reducer != nullptr) {
+				dbrx_log_trace("Merging reduction results of bric \"%s\" into bric \"%s\"", replica->getBric(entry.first).absolutePath(), reducer->absolutePath());
+				reducer->mergeReduction(dynamic_cast<const AbstractReducerBric&>(replica->getBric(entry.first)));
+			}
+		}
+	}
+}
+
+
+void ParallelMRBric::connectInputs() {
+	// Replicas are (re-)created here, so they are connected and initialized
+	// together with the rest of the bric hierarchy:
+	createReplicas();
+	MRBric::connectInputs();
+}
+
+
+std::vector<Bric*> ParallelMRBric::innerExecBrics() {
+	std::vector<Bric*> execBrics = MRBric::innerExecBrics();
+	execBrics.erase(
+		remove_if(execBrics.begin(), execBrics.end(), [&](Bric *bric) { return isReplica(bric); }),
+		execBrics.end()
+	);
+	return execBrics;
+}
+
+
+size_t ParallelMRBric::defaultInnerNThreads() const {
+	// Replicas already keep the threads busy:
+	return m_replicas.empty() ? MRBric::defaultInnerNThreads() : 1;
+}
+
+
+void ParallelMRBric::init() {
+	MRBric::init();
+
+	m_replicaPool.reset();
+
+	if (! m_replicas.empty()) {
+		size_t nParts = m_replicas.size() + 1;
+		checkPartitioning(partitionMappers(0, nParts));
+		for (size_t i = 0; i < m_replicas.size(); ++i) {
+			m_replicas[i]->partitionMappers(i + 1, nParts);
+			m_replicas[i]->setPartialReductions(true);
+		}
+
+		dbrx_log_debug("Using %s threads to execute replicas of bric \"%s\"", nParts, absolutePath());
+		enableConcurrentExec();
+		m_replicaPool = unique_ptr<ThreadPool>(new ThreadPool(nParts));
+	} else {
+		partitionMappers(0, 1);
+	}
+}
+
+
+PropVal ParallelMRBric::getConfig() const {
+	PropVal config = MRBric::getConfig();
+	for (const ParallelMRBric *replica: m_replicas) config.asProps().erase(replica->name());
+	return config;
+}
+
+
+void ParallelMRBric::processInput() {
+	if (m_replicaPool) {
+		m_replicaPool->parallelFor(m_replicas.size() + 1, [&](size_t i) {
+			if (i == 0) MRBric::processInput();
+			else m_replicas[i - 1]->processInput();
+		});
+		mergeReplicaResults();
+	} else {
+		MRBric::processInput();
+	}
+}
+
+
+} // namespace dbrx
@@ -0,0 +1,91 @@
+// Copyright (C) 2014 Oliver Schulz <oschulz@mpp.mpg.de>
+
+// This is free software; you can redistribute it and/or modify it under
+// the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation; either version 2.1 of the License, or
+// (at your option) any later version.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+
+
+
+#ifndef DBRX_PARALLELMRBRIC_H
+#define DBRX_PARALLELMRBRIC_H
+
+#include <unordered_set>
+
+#include "MRBric.h"
+
+
+namespace dbrx {
+
+
+// Data-parallel variant of MRBric. The inner bric graph is replicated
+// nReplicas times, the replicas process the same input concurrently. Each
+// replica only processes it's part of the data: Partitionable mapper brics
+// (e.g. RootTreeReader) directly inside the bric are partitioned among the
+// replicas. Mappers that don't support partitioning have to get their
+// input from a partitioned mapper upstream inside the bric, they would
+// produce all of their outputs in each replica otherwise. After all
+// replicas have finished, the results of the reducer brics directly inside
+// the bric are merged into the results of the original bric graph (see
+// AbstractReducerBric::mergeReduction). The reducers of the replicas
+// perform partial reductions only.
+//
+// Only reducer results are valid after merging, so consumers of these
+// results (e.g. file writers) should be placed outside of this bric.
+
+class ParallelMRBric: public MRBric {
+protected:
+	std::vector<ParallelMRBric*> m_replicas;
+
+	std::unique_ptr<ThreadPool> m_replicaPool;
+
+	virtual bool isReplica(const Bric *bric) const final;
+
+	virtual void removeReplicas() final;
+	virtual void createReplicas() final;
+
+	// Returns the mappers that were restricted to the partition
+	virtual std::unordered_set<const Bric*> partitionMappers(size_t partIdx, size_t nParts) final;
+
+	// Whether bric has a partitioned mapper upstream inside this bric
+	virtual bool hasPartitionedSource(Bric *bric, const std::unordered_set<const Bric*> &partitioned) final;
+
+	// Mappers that aren't partitioned and have no partitioned mapper
+	// upstream would produce all of their outputs in each replica
+	virtual void checkPartitioning(const std::unordered_set<const Bric*> &partitioned) final;
+
+	virtual void setPartialReductions(bool partial) final;
+
+	virtual void mergeReplicaResults() final;
+
+	void connectInputs() override;
+
+	std::vector<Bric*> innerExecBrics() override;
+
+	size_t defaultInnerNThreads() const override;
+
+	void init() override;
+
+public:
+	Param<int32_t> nReplicas{this, "nReplicas", "Number of replicas of the inner bric graph to execute in parallel (0 for default)", 0};
+
+	PropVal getConfig() const override;
+
+	void processInput() override;
+
+	using MRBric::MRBric;
+};
+
+
+} // namespace dbrx
+
+#endif // DBRX_PARALLELMRBRIC_H
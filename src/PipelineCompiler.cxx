@@ -0,0 +1,156 @@
+// Copyright (C) 2014 Oliver Schulz <oschulz@mpp.mpg.de>
+
+// This is free software; you can redistribute it and/or modify it under
+// the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation; either version 2.1 of the License, or
+// (at your option) any later version.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+
+
+#include "PipelineCompiler.h"
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+
+#include <TClass.h>
+#include <TSystem.h>
+
+#include "Bric.h"
+#include "TypeReflection.h"
+#include "logging.h"
+
+
+using namespace std;
+
+
+namespace dbrx {
+
+
+PropVal PipelineCompiler::s_compiledConfig;
+
+
+void PipelineCompiler::registerCompiledConfig(const std::string &json) {
+	dbrx_log_debug("Registering compiled pipeline configuration");
+	s_compiledConfig = PropVal::fromJSON(json);
+}
+
+
+void PipelineCompiler::load(const std::string &libName) {
+	dbrx_log_info("Loading compiled pipeline \"%s\"", libName);
+	if (gSystem->Load(libName.c_str()) < 0)
+		throw runtime_error("Couldn't load compiled pipeline \"%s\""_format(libName));
+	if (! hasCompiledConfig())
+		throw runtime_error("\"%s\" does not contain a compiled pipeline"_format(libName));
+}
+
+
+void PipelineCompiler::collectBricTypes(const PropVal &config) {
+	if (! config.isProps()) return;
+	if (config.contains(Bric::s_bricTypeKey) && config.at(Bric::s_bricTypeKey).isString()) {
+		const string &typeName = config.at(Bric::s_bricTypeKey).asString();
+		if (find(m_bricTypes.begin(), m_bricTypes.end(), typeName) == m_bricTypes.end())
+			m_bricTypes.push_back(typeName);
+	}
+	for (const auto &entry: config.asProps()) collectBricTypes(entry.second);
+}
+
+
+std::vector<std::string> PipelineCompiler::declFiles() const {
+	vector<string> files;
+	auto addFile = [&](const string &fileName) {
+		if (find(files.begin(), files.end(), fileName) == files.end()) files.push_back(fileName);
+	};
+
+	addFile(TypeReflection(typeid(PipelineCompiler)).getTClass()->GetDeclFileName());
+
+	for (const string &typeName: m_bricTypes) {
+		const TClass *cl = TypeReflection(typeName).getTClass();
+		const char* declFile = (cl != nullptr) ? cl->GetDeclFileName() : nullptr;
+		if ((declFile == nullptr) || (declFile[0] == 0))
+			throw runtime_error("Can't determine declaration file of bric type \"%s\""_format(typeName));
+		addFile(declFile);
+	}
+
+	for (const string &script: m_scripts) addFile(script);
+
+	return files;
+}
+
+
+void PipelineCompiler::generateCode(std::ostream &out) const {
+	out << "// Generated by \"dbrx compile\", do not edit." << "\n";
+	out << "\n";
+	for (const string &fileName: declFiles())
+		out << "#include \"" << fileName << "\"" << "\n";
+	out << "\n\n";
+	out << "namespace {" << "\n";
+	out << "\n";
+	out << "struct DbrxCompiledPipeline {" << "\n";
+	out << "\tDbrxCompiledPipeline() {" << "\n";
+	for (const string &typeName: m_bricTypes) {
+		out << "\t\tdbrx::Bric::registerBricType(\"" << typeName << "\", []() "
+			<< "{ return std::unique_ptr<dbrx::Bric>(new " << typeName << "()); });" << "\n";
+	}
+	out << "\t\tdbrx::PipelineCompiler::registerCompiledConfig(R\"__dbrx__(";
+	m_config.toJSON(out);
+	out << ")__dbrx__\");" << "\n";
+	out << "\t}" << "\n";
+	out << "} dbrxCompiledPipeline;" << "\n";
+	out << "\n";
+	out << "} // namespace" << "\n";
+}
+
+
+void PipelineCompiler::compile(const std::string &libName) const {
+	size_t dirEnd = libName.rfind('/');
+	size_t extPos = libName.rfind('.');
+	string srcName = ((extPos != libName.npos) && ((dirEnd == libName.npos) || (extPos > dirEnd)))
+		? libName.substr(0, extPos) + ".cxx" : libName + ".cxx";
+
+	dbrx_log_info("Generating pipeline code in \"%s\"", srcName);
+	ofstream out(srcName.c_str());
+	generateCode(out);
+	out.close();
+	if (! out) throw runtime_error("Couldn't write pipeline code to \"%s\""_format(srcName));
+
+	dbrx_log_info("Compiling pipeline \"%s\"", libName);
+	if (! gSystem->CompileMacro(srcName.c_str(), "kO", libName.c_str()))
+		throw runtime_error("Compilation of pipeline \"%s\" failed"_format(libName));
+}
+
+
+PipelineCompiler::PipelineCompiler(const PropVal &config)
+	: m_config(config)
+{
+	if (! m_config.isProps()) throw invalid_argument("Invalid pipeline configuration, must be an object");
+
+	// Scripts are compiled into the pipeline instead of being interpreted,
+	// so they are removed from the requirements of the embedded config
+	// (same classification as in ApplicationBric::applyConfig):
+	if (m_config.contains("requires")) {
+		PropVal::Array requires;
+		for (const PropVal &req: m_config.at("requires").asArray()) {
+			const string &dep = req.asString();
+			if ( (dep.find('(') == dep.npos) && ((dep.find(".c") != dep.npos) || (dep.find(".C") != dep.npos)) ) {
+				m_scripts.push_back(dep.substr(0, dep.find('+')));
+			} else {
+				requires.push_back(req);
+			}
+		}
+		m_config["requires"] = PropVal(std::move(requires));
+	}
+
+	if (m_config.contains("brics")) collectBricTypes(m_config.at("brics"));
+}
+
+
+} // namespace dbrx
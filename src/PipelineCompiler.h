@@ -0,0 +1,91 @@
+// Copyright (C) 2014 Oliver Schulz <oschulz@mpp.mpg.de>
+
+// This is free software; you can redistribute it and/or modify it under
+// the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation; either version 2.1 of the License, or
+// (at your option) any later version.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+
+
+#ifndef DBRX_PIPELINECOMPILER_H
+#define DBRX_PIPELINECOMPILER_H
+
+#include <iosfwd>
+#include <string>
+#include <vector>
+
+#include "Props.h"
+
+
+namespace dbrx {
+
+
+/// @brief Compiles a bric configuration into a shared library.
+///
+/// The generated code includes the declarations of all bric types used
+/// in the configuration (and the scripts they are defined in), registers
+/// native factories for them and embeds the resolved configuration. It
+/// is compiled with ACLiC. When the library is loaded, no bric types
+/// have to be resolved via ROOT reflection and no scripts have to be
+/// interpreted.
+///
+/// This only removes startup overhead: the bric graph is still built from
+/// the embedded configuration at run time, and events are processed via
+/// the same exec steps, terminals and values as without compilation.
+///
+/// All bric types and script requirements of the configuration have to
+/// be loaded before code is generated.
+
+class PipelineCompiler {
+protected:
+	static PropVal s_compiledConfig;
+
+	PropVal m_config;
+	std::vector<std::string> m_scripts;
+	std::vector<std::string> m_bricTypes;
+
+	virtual void collectBricTypes(const PropVal &config);
+
+	virtual std::vector<std::string> declFiles() const;
+
+public:
+	// Called by compiled pipeline libraries when they are loaded
+	static void registerCompiledConfig(const std::string &json);
+
+	static bool hasCompiledConfig() { return ! s_compiledConfig.isNone(); }
+	static const PropVal& compiledConfig() { return s_compiledConfig; }
+
+	// Loads a compiled pipeline library, its configuration is available
+	// via compiledConfig() afterwards
+	static void load(const std::string &libName);
+
+	// Configuration to embed, script requirements are compiled into the
+	// library and removed from it.
+	const PropVal& config() const { return m_config; }
+
+	const std::vector<std::string>& scripts() const { return m_scripts; }
+	const std::vector<std::string>& bricTypes() const { return m_bricTypes; }
+
+	virtual void generateCode(std::ostream &out) const;
+
+	// Writes the generated code to a source file next to the library
+	// and compiles it.
+	virtual void compile(const std::string &libName) const;
+
+	PipelineCompiler(const PropVal &config);
+
+	virtual ~PipelineCompiler() {}
+};
+
+
+} // namespace dbrx
+
+#endif // DBRX_PIPELINECOMPILER_H
@@ -21,18 +21,47 @@
 #include <TH1F.h>
 
 #include "Bric.h"
+#include "collbrics.h"
 
 
 namespace dbrx {
 
 
+// Fills single values or batches of values into a histogram
+
+template<typename T> struct RootHistFiller {
+	using Element = T;
+
+	template<typename Hist> static void fill(Hist &hist, const T &x) { hist.Fill(x); }
+};
+
+
+template<typename T> struct RootHistFiller< Batch<T> > {
+	using Element = T;
+
+	template<typename Hist> static void fill(Hist &hist, const Batch<T> &xs)
+		{ for (const auto &x: xs) hist.Fill(x); }
+};
+
+
+template<> struct RootHistFiller< Batch<Double_t> > {
+	using Element = Double_t;
+
+	template<typename Hist> static void fill(Hist &hist, const Batch<Double_t> &xs)
+		{ if (!xs.empty()) hist.FillN(Int_t(xs.size()), xs.data(), nullptr); }
+};
+
+
+
 template<typename T> class RootHistBuilder: public ReducerBric {
 public:
+	using Element = typename RootHistFiller<T>::Element;
+
 	using Hist = typename std::conditional<
-		std::is_same<T, Int_t>::value,
+		std::is_same<Element, Int_t>::value,
 		TH1I,
 		typename std::conditional<
-			std::is_same<T, Float_t>::value,
+			std::is_same<Element, Float_t>::value,
 			TH1F,
 			TH1D
 		>::type
@@ -51,10 +80,15 @@ public:
 		output.value() = std::unique_ptr<Hist>(
 			new Hist(histName.get().c_str(), histTitle.get().c_str(), nBins, xlow, xup)
 		);
+		output->SetDirectory(localTDirectory());
 	}
 
 	void processInput() override {
-		output->Fill(input);
+		RootHistFiller<T>::fill(output.get(), input.get());
+	}
+
+	void mergeReduction(const AbstractReducerBric &other) override {
+		output->Add(&dynamic_cast<const RootHistBuilder&>(other).output.value().get());
 	}
 
 	using ReducerBric::ReducerBric;
@@ -42,6 +42,9 @@ public:
 
 	Param<Int_t> nOut{this, "nOut", "Number of random values to produce for each input", 100};
 
+	// Uses gRandom
+	bool canRunConcurrently() const override { return false; }
+
 
 	void processInput() override;
 
@@ -0,0 +1,137 @@
+// Copyright (C) 2014 Oliver Schulz <oschulz@mpp.mpg.de>
+
+// This is free software; you can redistribute it and/or modify it under
+// the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation; either version 2.1 of the License, or
+// (at your option) any later version.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+
+
+
+#include "ThreadPool.h"
+
+#include <vector>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
+
+using namespace std;
+
+
+namespace dbrx {
+
+
+struct ThreadPool::Internals {
+	using Mutex = std::mutex;
+	using Lock = std::unique_lock<Mutex>;
+
+	struct Job {
+		const std::function<void(size_t)> &func;
+		const size_t n;
+		std::atomic<size_t> next{0};
+		size_t nActive = 0;
+		std::exception_ptr error;
+
+		Job(const std::function<void(size_t)> &f, size_t nCalls): func(f), n(nCalls) {}
+	};
+
+	Mutex mutex;
+	std::condition_variable jobAvailable;
+	std::condition_variable jobDone;
+	std::vector<std::thread> workers;
+	Job *job = nullptr;
+	bool stop = false;
+
+
+	void work(Job &j) {
+		size_t i = 0;
+		while ((i = atomic_fetch_add(&j.next, size_t(1))) < j.n) {
+			try { j.func(i); }
+			catch (...) {
+				Lock lock(mutex);
+				if (!j.error) j.error = current_exception();
+			}
+		}
+	}
+
+
+	void workerLoop() {
+		Lock lock(mutex);
+		while (true) {
+			jobAvailable.wait(lock, [&]{ return stop || ((job != nullptr) && (atomic_load(&job->next) < job->n)); });
+			if (stop) return;
+
+			Job &j = *job;
+			++j.nActive;
+			lock.unlock();
+			work(j);
+			lock.lock();
+			if (--j.nActive == 0) jobDone.notify_all();
+		}
+	}
+};
+
+
+size_t ThreadPool::hardwareConcurrency() {
+	size_t n = std::thread::hardware_concurrency();
+	return (n > 0) ? n : 1;
+}
+
+
+size_t ThreadPool::nThreads() const {
+	return m_internals->workers.size() + 1;
+}
+
+
+void ThreadPool::parallelFor(size_t n, const std::function<void(size_t)> &func) {
+	if (m_internals->workers.empty() || (n < 2)) {
+		for (size_t i = 0; i < n; ++i) func(i);
+	} else {
+		Internals::Job j(func, n);
+		Internals::Lock lock(m_internals->mutex);
+		m_internals->job = &j;
+		m_internals->jobAvailable.notify_all();
+		lock.unlock();
+
+		m_internals->work(j);
+
+		lock.lock();
+		m_internals->jobDone.wait(lock, [&]{ return j.nActive == 0; });
+		m_internals->job = nullptr;
+		lock.unlock();
+
+		if (j.error) rethrow_exception(j.error);
+	}
+}
+
+
+ThreadPool::ThreadPool(size_t nThreads)
+	: m_internals(new ThreadPool::Internals)
+{
+	for (size_t i = 1; i < nThreads; ++i)
+		m_internals->workers.push_back(std::thread([this]{ m_internals->workerLoop(); }));
+}
+
+
+ThreadPool::~ThreadPool() {
+	Internals::Lock lock(m_internals->mutex);
+	m_internals->stop = true;
+	m_internals->jobAvailable.notify_all();
+	lock.unlock();
+
+	for (auto &worker: m_internals->workers) worker.join();
+	delete m_internals;
+}
+
+
+} // namespace dbrx
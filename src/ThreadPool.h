@@ -0,0 +1,56 @@
+// Copyright (C) 2014 Oliver Schulz <oschulz@mpp.mpg.de>
+
+// This is free software; you can redistribute it and/or modify it under
+// the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation; either version 2.1 of the License, or
+// (at your option) any later version.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+
+
+#ifndef DBRX_THREADPOOL_H
+#define DBRX_THREADPOOL_H
+
+#include <functional>
+#include <cstddef>
+
+
+namespace dbrx {
+
+
+class ThreadPool {
+private:
+	struct Internals;
+	Internals *m_internals;
+
+public:
+	static size_t hardwareConcurrency();
+
+	// Total number of threads, including the calling thread.
+	size_t nThreads() const;
+
+	// Calls func(i) for all i in [0, n). Work is distributed over the pool
+	// threads and the calling thread. Returns after all calls have finished.
+	// If any call throws, the first exception caught is rethrown after all
+	// calls have finished.
+	void parallelFor(size_t n, const std::function<void(size_t)> &func);
+
+	ThreadPool(size_t nThreads);
+
+	ThreadPool(const ThreadPool &other) = delete;
+	ThreadPool& operator=(const ThreadPool &other) = delete;
+
+	virtual ~ThreadPool();
+};
+
+
+} // namespace dbrx
+
+#endif // DBRX_THREADPOOL_H
@@ -19,7 +19,10 @@
 #define DBRX_VALUE_H
 
 #include <memory>
+#include <new>
 #include <typeindex>
+#include <type_traits>
+#include <vector>
 
 #include "Props.h"
 
@@ -27,6 +30,10 @@
 namespace dbrx {
 
 
+class PrimaryValue;
+
+
+
 class Value {
 public:
 	virtual bool valid() const = 0;
@@ -82,10 +89,28 @@ public:
 	virtual void untypedOwn(void *p) = 0;
 	virtual void* untypedRelease() = 0;
 
+	// Copies the content of other (of the same type) into the existing
+	// content of this value, the content address doesn't change. Throws
+	// if the content type is not copy-assignable.
+	virtual void assignContentFrom(const Value &other) = 0;
+
+	// Swaps content with other (of the same type), content addresses don't
+	// change. Throws if the content type is neither movable nor copyable.
+	virtual void swapContent(WritableValue &other) = 0;
+
+	// Creates a new primary value of the same type, with default content.
+	virtual std::unique_ptr<PrimaryValue> createMatchingValue() const = 0;
+
 	virtual void fromPropVal(const PropVal &p) = 0;
 
-	friend void swap(WritableValue &a, WritableValue &b)
-		{ std::swap(*a.untypedPPtr(), *b.untypedPPtr()); }
+	// Content is swapped via release and own, as values may store their
+	// content inline (so content pointers can't simply be exchanged).
+	friend void swap(WritableValue &a, WritableValue &b) {
+		void *contentA = a.untypedRelease();
+		void *contentB = b.untypedRelease();
+		a.untypedOwn(contentB);
+		b.untypedOwn(contentA);
+	}
 };
 
 
@@ -94,6 +119,12 @@ class PrimaryValue: public virtual WritableValue {
 public:
 	bool valid() const final override { return true; }
 
+	// Maximum number of replaced or cleared content objects to keep for
+	// reuse by setToDefault and assignment to empty values (0 disables
+	// recycling).
+	virtual size_t maxRecycled() const = 0;
+	virtual void maxRecycled(size_t n) = 0;
+
 	friend void swap(PrimaryValue &a, PrimaryValue &b)
 		{ swap(static_cast<WritableValue &>(a), static_cast<WritableValue &>(b)); }
 };
@@ -146,6 +177,10 @@ public:
 
 
 
+template <typename T> class TypedPrimaryValue;
+
+
+
 template <typename T> class TypedWritableValue: public virtual WritableValue, public virtual TypedValue<T> {
 protected:
 	// SFINAE-based default implementation if assignFromPropVal not available for T.
@@ -154,6 +189,22 @@ protected:
 	template <typename U> static auto assignFromPropVal(U& x, const PropVal &p, PropValConvSpecial) -> decltype(assign_from(x, p)) { assign_from(x, p); }
 	static void assignFromPropVal(T &x, const PropVal &p, PropValConvGeneral) { throw std::invalid_argument("No conversion from PropVal to content type of this Value available"); }
 
+	// Content copy and swap, not available for all content types.
+	static void copyContent(T &to, const T &from, std::true_type) { to = from; }
+	static void copyContent(T &to, const T &from, std::false_type) { throw std::invalid_argument("Content type of this Value is not copy-assignable"); }
+
+	static void swapContent(T &a, T &b, std::true_type) { using std::swap; swap(a, b); }
+	static void swapContent(T &a, T &b, std::false_type) { throw std::invalid_argument("Content type of this Value is not swappable"); }
+
+	// Replaces the content by v (may be nullptr), the previous content is
+	// deleted. Overridden by values that don't keep their content on the
+	// heap.
+	virtual void resetContent(std::unique_ptr<T> &&v) {
+		std::unique_ptr<T> thisV(ptr()); *pptr() = nullptr;
+		std::swap(thisV, v);
+		*pptr() = thisV.release();
+	}
+
 public:
 	virtual operator T& () = 0;
 	virtual T* operator->() = 0;
@@ -163,39 +214,53 @@ public:
 
 	virtual T* ptr() = 0;
 
-	void setToDefault() final override { operator=(std::unique_ptr<T>( new T() )); }
-	void clear() final override { operator=(std::unique_ptr<T>((T*)nullptr)); }
+	// Puts a recycled content object in place, if the value is empty and
+	// one is available. Returns true if the value has content afterwards.
+	virtual bool reuseContent() { return ptr() != nullptr; }
 
-	void untypedOwn(void *p) final override { *this = std::unique_ptr<T>((T*)(p)); }
+	void setToDefault() override { resetContent(std::unique_ptr<T>( new T() )); }
+	void clear() final override { resetContent(std::unique_ptr<T>((T*)nullptr)); }
+
+	void untypedOwn(void *p) final override { resetContent(std::unique_ptr<T>((T*)(p))); }
 
 	void* untypedRelease() final override { return (void*)(release()); }
 
-	virtual T* release() final {
+	// Releases ownership of the content, which is always heap-allocated
+	// (a copy, if the content was stored inline).
+	virtual T* release() {
 		T* result = nullptr;
 		std::swap(result, *pptr());
 		return result;
 	}
 
 	TypedWritableValue<T>& operator=(const T &v) {
-		if (ptr() != nullptr) *ptr() = v;
-		else *pptr() = new T(v);
+		if (reuseContent()) *ptr() = v;
+		else resetContent(std::unique_ptr<T>( new T(v) ));
 		return *this;
 	}
 
 	TypedWritableValue<T>& operator=(T &&v) noexcept {
-		if (ptr() != nullptr) *ptr() = std::move(v);
-		else operator=(std::unique_ptr<T>( new T(std::move(v)) ));
+		if (reuseContent()) *ptr() = std::move(v);
+		else resetContent(std::unique_ptr<T>( new T(std::move(v)) ));
 		return *this;
 	}
 
-	TypedWritableValue<T>& operator=(std::unique_ptr<T> &&v) noexcept {
-		using namespace std;
-		unique_ptr<T> thisV(ptr()); *pptr() = nullptr;
-		swap(thisV, v);
-		*pptr() = thisV.release();
-		return *this;
+	TypedWritableValue<T>& operator=(std::unique_ptr<T> &&v) noexcept
+		{ resetContent(std::move(v)); return *this; }
+
+	void assignContentFrom(const Value &other) final override {
+		copyContent(get(), **other.typedPPtr<T>(),
+			std::integral_constant<bool, std::is_copy_assignable<T>::value>());
 	}
 
+	void swapContent(WritableValue &other) final override {
+		swapContent(get(), **other.typedPPtr<T>(),
+			std::integral_constant<bool, std::is_move_constructible<T>::value && std::is_move_assignable<T>::value>());
+	}
+
+	std::unique_ptr<PrimaryValue> createMatchingValue() const final override
+		{ return std::unique_ptr<PrimaryValue>(new TypedPrimaryValue<T>()); }
+
 	void fromPropVal(const PropVal &p) final override
 		{ assignFromPropVal(get(), p, PropValConvSpecial()); }
 
@@ -209,11 +274,78 @@ template <typename T> class TypedValueRef;
 
 
 
+// Small trivially copyable content (e.g. numbers) is stored inline, in the
+// value object itself, instead of on the heap. The content pointer then
+// points to the inline storage, so untypedPPtr() stays valid (and may be
+// used as a ROOT branch address) either way. Content released from an
+// inline value is returned as a heap-allocated copy.
+//
+// Heap-allocated content objects that are replaced or cleared can be kept
+// for reuse (see maxRecycled), to avoid allocation churn for values that
+// are rebuilt for every output. A recycled object is reset to default by
+// it's clear() member if it has one (keeping e.g. the capacity of
+// containers), otherwise it's re-constructed in place.
+
 template <typename T> class TypedPrimaryValue final
 	: public virtual PrimaryValue, public virtual TypedWritableValue<T>
 {
 protected:
+	static constexpr bool s_inlineStorage =
+		std::is_trivially_copyable<T>::value && (sizeof(T) <= 4 * sizeof(void*));
+
+	using InlineStorage = typename std::aligned_storage<
+		s_inlineStorage ? sizeof(T) : 1, s_inlineStorage ? alignof(T) : 1 >::type;
+
 	T* m_value = nullptr;
+	InlineStorage m_inline;
+
+	std::vector<T*> m_recycled;
+	size_t m_maxRecycled = 0;
+
+	T* inlinePtr() { return reinterpret_cast<T*>(&m_inline); }
+
+	bool isInline() const { return s_inlineStorage && (m_value == reinterpret_cast<const T*>(&m_inline)); }
+
+	template<typename... Args> T* newContent(Args&&... args) {
+		if (s_inlineStorage) return new(inlinePtr()) T(std::forward<Args>(args)...);
+		else return new T(std::forward<Args>(args)...);
+	}
+
+	void deleteContent() {
+		if (! isInline()) delete m_value;
+		m_value = nullptr;
+	}
+
+	// Takes ownership of p, only objects of exactly type T are recycled.
+	void recycleContent(T *p) {
+		if ((p != nullptr) && (m_recycled.size() < m_maxRecycled) && (typeid(*p) == typeid(T)))
+			m_recycled.push_back(p);
+		else delete p;
+	}
+
+	T* popRecycled() {
+		if (m_recycled.empty()) return nullptr;
+		T* p = m_recycled.back();
+		m_recycled.pop_back();
+		return p;
+	}
+
+	template <typename U> static auto resetToDefault(U &x, int) -> decltype(x.clear(), void()) { x.clear(); }
+	static void resetToDefault(T &x, long) { x.~T(); new(&x) T(); }
+
+	void resetContent(std::unique_ptr<T> &&v) final override {
+		if (s_inlineStorage) {
+			if (v) {
+				if (isInline()) *m_value = *v;
+				else { deleteContent(); m_value = newContent(*v); }
+				v.reset();
+			} else deleteContent();
+		} else if (m_maxRecycled > 0) {
+			T* previous = m_value;
+			m_value = v.release();
+			recycleContent(previous);
+		} else TypedWritableValue<T>::resetContent(std::move(v));
+	}
 
 public:
 	bool empty() const final override { return m_value == nullptr; }
@@ -236,6 +368,40 @@ public:
 	const T* ptr() const final override { return m_value; }
 	T* ptr() final override { return m_value; }
 
+	size_t maxRecycled() const final override { return m_maxRecycled; }
+
+	void maxRecycled(size_t n) final override {
+		m_maxRecycled = s_inlineStorage ? 0 : n;
+		while (m_recycled.size() > m_maxRecycled) delete popRecycled();
+	}
+
+	bool reuseContent() final override {
+		if (m_value == nullptr) m_value = popRecycled();
+		return m_value != nullptr;
+	}
+
+	void setToDefault() final override {
+		if (s_inlineStorage) { deleteContent(); m_value = newContent(); }
+		else if (m_maxRecycled > 0) {
+			// Only reset content in place if it's exactly of type T:
+			if (reuseContent() && (typeid(*m_value) == typeid(T))) resetToDefault(*m_value, 0);
+			else {
+				T* p = popRecycled();
+				if (p != nullptr) resetToDefault(*p, 0);
+				else p = new T();
+				resetContent(std::unique_ptr<T>(p));
+			}
+		} else TypedWritableValue<T>::setToDefault();
+	}
+
+	T* release() final override {
+		if (isInline()) {
+			T* result = new T(*m_value);
+			m_value = nullptr;
+			return result;
+		} else return TypedWritableValue<T>::release();
+	}
+
 	TypedPrimaryValue<T>& operator=(const T &v)
 		{ TypedWritableValue<T>::operator=(v); return *this; }
 
@@ -248,21 +414,27 @@ public:
 	TypedPrimaryValue<T>& operator=(const TypedPrimaryValue<T>& v) = delete;
 	TypedPrimaryValue<T>& operator=(TypedPrimaryValue<T> &&v) = delete;
 
-	TypedPrimaryValue(): m_value(new T()) {}
+	TypedPrimaryValue(): m_value(newContent()) {}
 
 	TypedPrimaryValue(std::nullptr_t) {};
 
-	TypedPrimaryValue(const TypedPrimaryValue<T> &other) { *this = other.get(); }
+	TypedPrimaryValue(const TypedPrimaryValue<T> &other): m_value(newContent(other.get())) {}
 
-	TypedPrimaryValue(TypedPrimaryValue<T> &&other) { std::swap(m_value, other.m_value); }
+	TypedPrimaryValue(TypedPrimaryValue<T> &&other) {
+		if (other.isInline()) { m_value = newContent(std::move(*other.m_value)); other.m_value = nullptr; }
+		else std::swap(m_value, other.m_value);
+	}
 
-	TypedPrimaryValue(const T &v) { *this = v; }
+	TypedPrimaryValue(const T &v): m_value(newContent(v)) {}
 
-	TypedPrimaryValue(T &&v) { *this = std::move(v); }
+	TypedPrimaryValue(T &&v): m_value(newContent(std::move(v))) {}
 
 	TypedPrimaryValue(std::unique_ptr<T> &&v) = delete;
 
-	~TypedPrimaryValue() override { if (m_value != nullptr) delete m_value; }
+	~TypedPrimaryValue() override {
+		deleteContent();
+		for (T *p: m_recycled) delete p;
+	}
 
 	friend void swap(TypedPrimaryValue &a, TypedPrimaryValue &b)
 		{ swap(static_cast<PrimaryValue &>(a), static_cast<PrimaryValue &>(b)); }
@@ -276,6 +448,15 @@ template <typename T> class TypedValueRef final
 protected:
 	T* * m_value = nullptr;
 
+	// Source value, content ownership changes are delegated to it (the
+	// source may store its content inline).
+	TypedWritableValue<T>* m_source = nullptr;
+
+	void resetContent(std::unique_ptr<T> &&v) final override {
+		if (m_source != nullptr) *m_source = std::move(v);
+		else TypedWritableValue<T>::resetContent(std::move(v));
+	}
+
 public:
 	bool valid() const final override { return (m_value != nullptr); }
 	bool empty() const final override { return *m_value == nullptr; }
@@ -287,11 +468,13 @@ public:
 	const T& get() const final override { return **m_value; }
 	T& get() final override { return **m_value; }
 
-	void referTo(WritableValue &source) final override
-		{ m_value = source.typedPPtr<T>(); }
+	void referTo(WritableValue &source) final override {
+		m_value = source.typedPPtr<T>();
+		m_source = dynamic_cast<TypedWritableValue<T>*>(&source);
+	}
 
 	bool isReferringTo(const WritableValue &source) const final override
-		{ return m_value == source.typedPPtr<T>(); }
+		{ return m_value == static_cast<const Value&>(source).typedPPtr<T>(); }
 
 	const std::type_info& typeInfo() const final override { return typeid(T); }
 
@@ -304,6 +487,21 @@ public:
 	const T* ptr() const final override { return *m_value; }
 	T* ptr() final override { return *m_value; }
 
+	bool reuseContent() final override {
+		if (m_source != nullptr) return m_source->reuseContent();
+		else return TypedWritableValue<T>::reuseContent();
+	}
+
+	void setToDefault() final override {
+		if (m_source != nullptr) m_source->setToDefault();
+		else TypedWritableValue<T>::setToDefault();
+	}
+
+	T* release() final override {
+		if (m_source != nullptr) return m_source->release();
+		else return TypedWritableValue<T>::release();
+	}
+
 	TypedValueRef<T>& operator=(const T &v)
 		{ TypedWritableValue<T>::operator=(v); return *this; }
 
@@ -318,11 +516,11 @@ public:
 
 	TypedValueRef() = default;
 
-	TypedValueRef(TypedValueRef<T> &other) : m_value(other.pptr()) {}
+	TypedValueRef(TypedValueRef<T> &other) : m_value(other.pptr()), m_source(&other) {}
 
 	TypedValueRef(TypedPrimaryValue<T> &&other) { std::swap(m_value, other.m_value); }
 
-	TypedValueRef(TypedWritableValue<T> &v) : m_value(v.pptr()) {}
+	TypedValueRef(TypedWritableValue<T> &v) : m_value(v.pptr()), m_source(&v) {}
 
 	TypedValueRef(WritableValue &source) { referTo(source); }
 
@@ -337,6 +535,7 @@ template <typename T> class TypedConstValueRef final
 {
 protected:
 	const T* const * m_value = nullptr;
+	const Value* m_source = nullptr;
 
 public:
 	bool valid() const final override { return (m_value != nullptr); }
@@ -347,7 +546,10 @@ public:
 	const T& get() const final override { return **m_value; }
 
 	void referTo(const Value &source) final override
-		{ m_value = source.typedPPtr<T>(); }
+		{ m_value = source.typedPPtr<T>(); m_source = &source; }
+
+	// Value this refers to (if set via referTo or on construction)
+	const Value* source() const { return m_source; }
 
 	bool isReferringTo(const Value &source) const final override
 		{ return m_value == source.typedPPtr<T>(); }
@@ -365,11 +567,11 @@ public:
 
 	TypedConstValueRef() = default;
 
-	TypedConstValueRef(const TypedConstValueRef<T> &other) : m_value(other.pptr()) {}
+	TypedConstValueRef(const TypedConstValueRef<T> &other) : m_value(other.pptr()), m_source(other.m_source) {}
 
 	TypedConstValueRef(TypedPrimaryValue<T> &&other) { std::swap(m_value, other.m_value); }
 
-	TypedConstValueRef(const TypedValue<T> &other) : m_value(other.pptr()) {}
+	TypedConstValueRef(const TypedValue<T> &other) : m_value(other.pptr()), m_source(&other) {}
 
 	TypedConstValueRef(const Value &source) { referTo(source); }	
 };
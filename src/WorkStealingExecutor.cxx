@@ -0,0 +1,275 @@
+// Copyright (C) 2014 Oliver Schulz <oschulz@mpp.mpg.de>
+
+// This is free software; you can redistribute it and/or modify it under
+// the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation; either version 2.1 of the License, or
+// (at your option) any later version.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+
+
+
+#include "WorkStealingExecutor.h"
+
+#include <algorithm>
+#include <deque>
+#include <memory>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
+
+using namespace std;
+
+
+namespace dbrx {
+
+
+struct WorkStealingExecutor::Internals {
+	using Mutex = std::mutex;
+	using Lock = std::unique_lock<Mutex>;
+
+	struct WorkerQueue {
+		Mutex mutex;
+		std::deque<Bric*> brics;
+	};
+
+	// Executor and queue index of the current thread, if it's executing
+	// brics for an executor:
+	static thread_local Internals *t_current;
+	static thread_local size_t t_queueIdx;
+
+	// Queue 0 belongs to the thread that calls run
+	std::vector< std::unique_ptr<WorkerQueue> > queues;
+	std::vector<std::thread> workers;
+
+	// Brics queued or running:
+	std::atomic<size_t> nPending{0};
+	std::atomic<size_t> nQueued{0};
+	std::atomic<size_t> nSleeping{0};
+	std::atomic<size_t> nextQueue{0};
+	std::atomic<bool> aborted{false};
+
+	Mutex mutex;
+	std::condition_variable workAvailable;
+	std::exception_ptr error;
+	bool stop = false;
+
+	// For brics that can't run concurrently
+	Mutex sequentialMutex;
+
+
+	void enqueue(Bric *bric) {
+		size_t idx = (t_current == this) ? t_queueIdx : atomic_fetch_add(&nextQueue, size_t(1)) % queues.size();
+		WorkerQueue &queue = *queues[idx];
+		{
+			Lock lock(queue.mutex);
+			queue.brics.push_back(bric);
+		}
+		atomic_fetch_add(&nQueued, size_t(1));
+		if (atomic_load(&nSleeping) > 0) {
+			Lock lock(mutex);
+			workAvailable.notify_all();
+		}
+	}
+
+
+	Bric* take(size_t idx) {
+		if (atomic_load(&nQueued) == 0) return nullptr;
+
+		// Newest bric from own queue first, its inputs are likely in cache:
+		{
+			WorkerQueue &queue = *queues[idx];
+			Lock lock(queue.mutex);
+			if (!queue.brics.empty()) {
+				Bric *bric = queue.brics.back();
+				queue.brics.pop_back();
+				atomic_fetch_sub(&nQueued, size_t(1));
+				return bric;
+			}
+		}
+
+		// Steal oldest bric from other queues:
+		for (size_t i = 1; i < queues.size(); ++i) {
+			WorkerQueue &queue = *queues[(idx + i) % queues.size()];
+			Lock lock(queue.mutex);
+			if (!queue.brics.empty()) {
+				Bric *bric = queue.brics.front();
+				queue.brics.pop_front();
+				atomic_fetch_sub(&nQueued, size_t(1));
+				return bric;
+			}
+		}
+
+		return nullptr;
+	}
+
+
+	void finishPending() {
+		if (atomic_fetch_sub(&nPending, size_t(1)) == 1) {
+			Lock lock(mutex);
+			workAvailable.notify_all();
+		}
+	}
+
+
+	bool execBric(Bric *bric) {
+		if (atomic_load(&aborted)) return false;
+		try {
+			dbrx_log_trace("Executing bric \"%s\"", bric->absolutePath());
+			if (bric->canRunConcurrently()) {
+				return bric->nextFusedExecStep();
+			} else {
+				Lock lock(sequentialMutex);
+				return bric->nextFusedExecStep();
+			}
+		}
+		catch (...) {
+			Lock lock(mutex);
+			if (!error) error = current_exception();
+			atomic_store(&aborted, true);
+			return false;
+		}
+	}
+
+
+	void execute(Bric *bric) {
+		auto &state = schedState(bric);
+		atomic_store(&state, uint8_t(RUNNING));
+
+		bool execResult = execBric(bric);
+
+		// Brics that produced output may be able to produce more without
+		// any changes in their sources or dests:
+		bool again = execResult && !bric->fusedExecFinished() && !atomic_load(&aborted);
+
+		uint8_t expected = RUNNING;
+		if (!again && atomic_compare_exchange_strong(&state, &expected, uint8_t(IDLE))) {
+			finishPending();
+		} else {
+			// Notified during execution (or has to run again)
+			atomic_store(&state, uint8_t(QUEUED));
+			enqueue(bric);
+		}
+	}
+
+
+	void notify(Bric *bric) {
+		auto &state = schedState(bric);
+		uint8_t current = atomic_load(&state);
+		while (true) {
+			if (current == IDLE) {
+				if (atomic_compare_exchange_weak(&state, &current, uint8_t(QUEUED))) {
+					atomic_fetch_add(&nPending, size_t(1));
+					enqueue(bric);
+					return;
+				}
+			} else if (current == RUNNING) {
+				if (atomic_compare_exchange_weak(&state, &current, uint8_t(RUNNING_NOTIFIED))) return;
+			} else {
+				// Already queued or notified
+				return;
+			}
+		}
+	}
+
+
+	// Executes queued brics. The calling thread of run (queue 0) returns
+	// when no brics are pending anymore, worker threads when stopped.
+	void work(size_t idx) {
+		Internals *prevCurrent = t_current;
+		size_t prevQueueIdx = t_queueIdx;
+		t_current = this;
+		t_queueIdx = idx;
+
+		while (true) {
+			Bric *bric = take(idx);
+			if (bric != nullptr) {
+				execute(bric);
+			} else {
+				Lock lock(mutex);
+				atomic_fetch_add(&nSleeping, size_t(1));
+				if (idx == 0) {
+					workAvailable.wait(lock, [&]{ return atomic_load(&nQueued) > 0 || atomic_load(&nPending) == 0; });
+					atomic_fetch_sub(&nSleeping, size_t(1));
+					if (atomic_load(&nPending) == 0) break;
+				} else {
+					workAvailable.wait(lock, [&]{ return stop || atomic_load(&nQueued) > 0; });
+					atomic_fetch_sub(&nSleeping, size_t(1));
+					if (stop) break;
+				}
+			}
+		}
+
+		t_current = prevCurrent;
+		t_queueIdx = prevQueueIdx;
+	}
+};
+
+
+thread_local WorkStealingExecutor::Internals* WorkStealingExecutor::Internals::t_current = nullptr;
+thread_local size_t WorkStealingExecutor::Internals::t_queueIdx = 0;
+
+
+size_t WorkStealingExecutor::nThreads() const {
+	return m_internals->queues.size();
+}
+
+
+void WorkStealingExecutor::run(const std::vector<Bric*> &brics) {
+	Internals &m = *m_internals;
+
+	atomic_store(&m.aborted, false);
+	m.error = nullptr;
+
+	// Keeps execution from being considered finished while queueing brics
+	atomic_fetch_add(&m.nPending, size_t(1));
+	for (Bric *bric: brics) m.notify(bric);
+	m.finishPending();
+
+	m.work(0);
+
+	if (m.error) {
+		exception_ptr error = m.error;
+		m.error = nullptr;
+		rethrow_exception(error);
+	}
+}
+
+
+void WorkStealingExecutor::bricReady(Bric *bric) {
+	m_internals->notify(bric);
+}
+
+
+WorkStealingExecutor::WorkStealingExecutor(size_t nThreads)
+	: m_internals(new WorkStealingExecutor::Internals)
+{
+	size_t nQueues = max(nThreads, size_t(1));
+	for (size_t i = 0; i < nQueues; ++i)
+		m_internals->queues.push_back(unique_ptr<Internals::WorkerQueue>(new Internals::WorkerQueue));
+	for (size_t i = 1; i < nQueues; ++i)
+		m_internals->workers.push_back(std::thread([this, i]{ m_internals->work(i); }));
+}
+
+
+WorkStealingExecutor::~WorkStealingExecutor() {
+	Internals::Lock lock(m_internals->mutex);
+	m_internals->stop = true;
+	m_internals->workAvailable.notify_all();
+	lock.unlock();
+
+	for (auto &worker: m_internals->workers) worker.join();
+	delete m_internals;
+}
+
+
+} // namespace dbrx
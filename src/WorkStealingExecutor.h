@@ -0,0 +1,64 @@
+// Copyright (C) 2014 Oliver Schulz <oschulz@mpp.mpg.de>
+
+// This is free software; you can redistribute it and/or modify it under
+// the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation; either version 2.1 of the License, or
+// (at your option) any later version.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+
+
+
+#ifndef DBRX_WORKSTEALINGEXECUTOR_H
+#define DBRX_WORKSTEALINGEXECUTOR_H
+
+#include <vector>
+#include <cstddef>
+
+#include "Bric.h"
+
+
+namespace dbrx {
+
+
+// Executes brics on a pool of threads, each with its own queue of ready
+// brics. Brics that become ready are queued on the thread that notified
+// them, idle threads steal brics from the queues of busy threads. Each bric
+// is executed by only one thread at a time, brics that can't run
+// concurrently are executed one after another.
+class WorkStealingExecutor final: public Bric::Scheduler {
+private:
+	struct Internals;
+	Internals *m_internals;
+
+public:
+	// Total number of threads, including the calling thread.
+	size_t nThreads() const;
+
+	// Executes the given brics, and all brics that become ready as a
+	// consequence, until no bric is ready anymore. The calling thread takes
+	// part in the execution. If any execution throws, the remaining brics
+	// are skipped and the first exception caught is rethrown.
+	void run(const std::vector<Bric*> &brics);
+
+	void bricReady(Bric *bric) override;
+
+	WorkStealingExecutor(size_t nThreads);
+
+	WorkStealingExecutor(const WorkStealingExecutor &other) = delete;
+	WorkStealingExecutor& operator=(const WorkStealingExecutor &other) = delete;
+
+	~WorkStealingExecutor() override;
+};
+
+
+} // namespace dbrx
+
+#endif // DBRX_WORKSTEALINGEXECUTOR_H
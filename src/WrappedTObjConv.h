@@ -38,7 +38,8 @@ public:
 	Output<WrappedTObj<T>> output{this};
 
 	void processInput() override {
-		output = WrappedTObj<T>(std::unique_ptr<T>(dynamic_cast<T*>(input->Clone())));
+		if (input.canTake()) output = WrappedTObj<T>(input.take());
+		else output = WrappedTObj<T>(std::unique_ptr<T>(dynamic_cast<T*>(input->Clone())));
 	}
 
 	using WrappedTObjConv::WrappedTObjConv;
@@ -52,7 +53,8 @@ public:
 	Output<T> output{this};
 
 	void processInput() override {
-		output = std::unique_ptr<T>(dynamic_cast<T*>(input->get().Clone()));
+		if (input.canTake()) output = input.take()->release();
+		else output = std::unique_ptr<T>(dynamic_cast<T*>(input->get().Clone()));
 	}
 
 	using WrappedTObjConv::WrappedTObjConv;
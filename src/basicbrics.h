@@ -18,6 +18,8 @@
 #ifndef DBRX_BASICBRICS_H
 #define DBRX_BASICBRICS_H
 
+#include <type_traits>
+
 #include "Bric.h"
 #include "format.h"
 
@@ -62,7 +64,12 @@ public:
 	Input<T> input{this};
 	Output<T> output{this};
 
-	void processInput() override { output.value() = input.value(); }
+	void processInput() override {
+		// Taking over the input content only pays off for types that are
+		// expensive to copy:
+		if (!std::is_trivially_copyable<T>::value && input.canTake()) output = input.take();
+		else output.value() = input.value();
+	}
 
 	using TransformBric::TransformBric;
 };
@@ -18,7 +18,9 @@
 #ifndef DBRX_COLLBRICS_H
 #define DBRX_COLLBRICS_H
 
+#include <stdexcept>
 #include <utility>
+#include <vector>
 
 #include "Bric.h"
 
@@ -26,6 +28,11 @@
 namespace dbrx {
 
 
+// Contiguous batch of values, allows brics to process multiple events in a
+// single execution step.
+template<typename T> using Batch = std::vector<T>;
+
+
 template<typename Coll> class CollIterBric final: public MapperBric {
 public:
 	Input<Coll> input{this};
@@ -82,10 +89,62 @@ public:
 		output->push_back(input);
 	}
 
+	void mergeReduction(const AbstractReducerBric &other) override {
+		for (const auto &x: dynamic_cast<const CollBuilderBric&>(other).output.value().get())
+			output->push_back(x);
+	}
+
 	using ReducerBric::ReducerBric;
 };
 
 
+template<typename T> class BatchBuilderBric final: public MapperBric {
+protected:
+	bool m_batchDone = false;
+
+	bool batchFull() { return ssize_t(output->size()) >= batchSize; }
+
+public:
+	Input<T> input{this};
+
+	Output<Batch<T>> output{this};
+
+	Param<int32_t> batchSize{this, "batchSize", "Number of input values per output batch", 1024};
+
+	void init() override {
+		if (batchSize < 1) throw std::invalid_argument("Invalid batch size %s for bric \"%s\""_format(batchSize.get(), absolutePath()));
+	}
+
+	void resetExec() override {
+		MapperBric::resetExec();
+		// Discard incomplete batch of previous execution:
+		if (! output.value().empty()) output->clear();
+		m_batchDone = false;
+	}
+
+	void processInput() override {
+		if (m_batchDone) {
+			output->clear();
+			m_batchDone = false;
+		}
+		output->push_back(input);
+	}
+
+	bool nextOutput() override {
+		if (!m_batchDone && batchFull()) return m_batchDone = true;
+		else return false;
+	}
+
+	bool nextFinalOutput() override {
+		// Output remaining values as a final, possibly incomplete, batch
+		if (!m_batchDone && !output->empty()) return m_batchDone = true;
+		else return false;
+	}
+
+	using MapperBric::MapperBric;
+};
+
+
 } // namespace dbrx
 
 #endif // DBRX_COLLBRICS_H
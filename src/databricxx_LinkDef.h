@@ -6,6 +6,7 @@
 // basicbrics.h
 
 // funcbrics.h
+#pragma link C++ class dbrx::ExpressionBric-;
 
 // collbrics.h
 
@@ -17,6 +18,7 @@
 
 // rootiobrics.h
 #pragma link C++ class dbrx::RootTreeReader-;
+#pragma link C++ class dbrx::RootTreeEntryListReader-;
 #pragma link C++ class dbrx::RootTreeWriter-;
 #pragma link C++ class dbrx::RootFileReader-;
 #pragma link C++ class dbrx::RootFileWriter-;
@@ -44,6 +46,7 @@
 #pragma link C++ class dbrx::ExportBric-;
 #pragma link C++ class dbrx::MapperBric-;
 #pragma link C++ class dbrx::TransformBric-;
+#pragma link C++ class dbrx::FilterBric-;
 #pragma link C++ class dbrx::ReducerBric-;
 
 // DbrxTools.h
@@ -64,6 +67,12 @@
 
 #pragma link C++ class dbrx::NameTable-;
 
+// ParallelMRBric.h
+#pragma link C++ class dbrx::ParallelMRBric-;
+
+// PipelineCompiler.h
+#pragma link C++ class dbrx::PipelineCompiler-;
+
 // Props.h
 #pragma link C++ class dbrx::PropVal-;
 
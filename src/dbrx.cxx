@@ -31,6 +31,9 @@
 #include "Props.h"
 #include "ApplicationBric.h"
 #include "ApplicationConfig.h"
+#include "MRBric.h"
+#include "PipelineCompiler.h"
+#include "ThreadPool.h"
 
 
 using namespace std;
@@ -100,12 +103,18 @@ void task_run_printUsage(const char* progName) {
 	cerr << "-w              Enable HTTP server" << endl;
 	cerr << "-p PORT         HTTP server port (default: 8080)" << endl;
 	cerr << "-k              Don't exit after processing (e.g. to keep HTTP server running)" << endl;
+	cerr << "-j N            Number of threads per MR bric (default: 1, 0: number of CPUs)" << endl;
+	cerr << "-P FILE         Profile bric execution, write report to FILE (JSON)" << endl;
+	cerr << "-L PIPELINE     Load compiled pipeline (see \"compile\" command)" << endl;
+	cerr << "-A              Allocate dynamic brics and terminals in an arena" << endl;
 	cerr << "-V NAME=VALUE   Define variable value for configuration" << endl;
 	cerr << "-s              Disable variable substitution in configuration" << endl;
 	cerr << "-e              Do not use environment variables in configuration" << endl;
 	cerr << "" << endl;
 	cerr << "Run the given bric configuration. If multiple configuration are given, they" << endl;
-	cerr << "are merged together (from left to right)." << endl;
+	cerr << "are merged together (from left to right). The configuration of a compiled" << endl;
+	cerr << "pipeline is used as the base configuration, further configurations are" << endl;
+	cerr << "merged into it." << endl;
 }
 
 
@@ -113,15 +122,27 @@ int task_run(int argc, char *argv[], char *envp[]) {
 	bool enableHTTP = false;
 	uint16_t httpPort = 8080;
 	bool keepRunning = false;
+	string profileReport;
+	string pipeline;
+	bool useArena = false;
 
 	int opt = 0;
-	while ((opt = getopt(argc, argv, "?c:l:wp:kV:se")) != -1) {
+	while ((opt = getopt(argc, argv, "?c:l:wp:kj:P:L:AV:se")) != -1) {
 		switch (opt) {
 			case '?': { task_run_printUsage(argv[0]); return 0; }
 			case 'l': { g_config.applyLogLevelOverride(optarg); break; }
 			case 'w': { enableHTTP = true; break; }
 			case 'p': { httpPort = atoi(optarg); break; }
 			case 'k': { keepRunning = true; break; }
+			case 'j': {
+				int n = atoi(optarg);
+				if (n < 0) throw invalid_argument("Invalid number of threads");
+				MRBric::defaultNThreads((n > 0) ? size_t(n) : ThreadPool::hardwareConcurrency());
+				break;
+			}
+			case 'P': { profileReport = optarg; break; }
+			case 'L': { pipeline = optarg; break; }
+			case 'A': { useArena = true; break; }
 			case 'V': { g_config.addVar(optarg); break; }
 			case 's': { g_config.substVars(false); break; }
 			case 'e': { g_config.useEnvVars(false); break; }
@@ -129,11 +150,16 @@ int task_run(int argc, char *argv[], char *envp[]) {
 		}
 	}
 
-	if (! (optind < argc)) {
+	if (! (optind < argc) && pipeline.empty()) {
 		task_run_printUsage(argv[0]);
 		return 1;
 	}
 
+	if (! pipeline.empty()) {
+		PipelineCompiler::load(pipeline);
+		g_config.config().asProps() += PipelineCompiler::compiledConfig().asProps();
+	}
+
 	while (optind < argc) {
 		std::string from = argv[optind++];
 		g_config.addConfigFromFile(from);
@@ -149,7 +175,9 @@ int task_run(int argc, char *argv[], char *envp[]) {
 	}
 
 	ApplicationBric app("dbrx");
+	if (useArena) app.enableArena();
 	app.applyConfig(g_config.config());
+	if (! profileReport.empty()) app.profileReport = profileReport;
 	app.run();
 
 	if (keepRunning) {
@@ -162,9 +190,69 @@ int task_run(int argc, char *argv[], char *envp[]) {
 }
 
 
+void task_compile_printUsage(const char* progName) {
+	cerr << "Syntax: " << progName << " [OPTIONS] -o PIPELINE CONFIG.." << endl;
+	cerr << "" << endl;
+	cerr << "Options:" << endl;
+	cerr << "-?              Show help" << endl;
+	cerr << "-o PIPELINE     Output library (e.g. \"pipeline.so\")" << endl;
+	cerr << "-l LEVEL        Set logging level (default: \"info\")" << endl;
+	cerr << "-V NAME=VALUE   Define variable value for configuration" << endl;
+	cerr << "-s              Disable variable substitution in configuration" << endl;
+	cerr << "-e              Do not use environment variables in configuration" << endl;
+	cerr << "" << endl;
+	cerr << "Compile the given bric configuration into a shared library, using ACLiC." << endl;
+	cerr << "The library contains the resolved configuration, native factories for all" << endl;
+	cerr << "bric types used and the scripts required by the configuration. Run it with" << endl;
+	cerr << "\"run -L PIPELINE\". This only saves script interpretation and bric type" << endl;
+	cerr << "lookup at startup: the bric graph is still built from the configuration at" << endl;
+	cerr << "run time, and per-event execution is the same as without compilation." << endl;
+}
+
+
+int task_compile(int argc, char *argv[], char *envp[]) {
+	string output;
+
+	int opt = 0;
+	while ((opt = getopt(argc, argv, "?o:l:V:se")) != -1) {
+		switch (opt) {
+			case '?': { task_compile_printUsage(argv[0]); return 0; }
+			case 'o': { output = optarg; break; }
+			case 'l': { g_config.applyLogLevelOverride(optarg); break; }
+			case 'V': { g_config.addVar(optarg); break; }
+			case 's': { g_config.substVars(false); break; }
+			case 'e': { g_config.useEnvVars(false); break; }
+			default: throw invalid_argument("Unkown command line option");
+		}
+	}
+
+	if (! (optind < argc) || output.empty()) {
+		task_compile_printUsage(argv[0]);
+		return 1;
+	}
+
+	while (optind < argc) {
+		std::string from = argv[optind++];
+		g_config.addConfigFromFile(from);
+	}
+	g_config.finalize();
+	g_config.applyLoggingConfig();
+
+	// Load requirements and check the configuration by creating the bric
+	// hierarchy, all bric types have to be known for code generation:
+	ApplicationBric app("dbrx");
+	app.applyConfig(g_config.config());
+
+	PipelineCompiler(g_config.config()).compile(output);
+
+	return 0;
+}
+
+
 void main_printUsage(const char* progName) {
 	cerr << "Syntax: " << progName << " COMMAND ..." << endl << endl;
 	cerr << "Commands: " << endl;
+	cerr << "  compile" << endl;
 	cerr << "  get-config" << endl;
 	cerr << "  run" << endl;
 	cerr << "" << endl;
@@ -212,7 +300,8 @@ int main(int argc, char *argv[], char *envp[]) {
 
 
 		if (cmd == "-?") { main_printUsage(argv[0]); return 0; }
-		if (cmd == "get-config") return task_get_config(cmd_argc, cmd_argv, envp);
+		if (cmd == "compile") return task_compile(cmd_argc, cmd_argv, envp);
+		else if (cmd == "get-config") return task_get_config(cmd_argc, cmd_argv, envp);
 		else if (cmd == "run") return task_run(cmd_argc, cmd_argv, envp);
 		else throw invalid_argument("Command \"%s\" not supported."_format(cmd));
 	}
@@ -17,6 +17,13 @@
 
 #include "funcbrics.h"
 
+#include <cctype>
+
+#include <TInterpreter.h>
+
+#include "logging.h"
+#include "TypeReflection.h"
+
 
 using namespace std;
 
@@ -24,4 +31,82 @@ using namespace std;
 namespace dbrx {
 
 
+void ExpressionBric::Variables::applyConfig(const PropVal& config) {
+	m_inputSources.clear();
+	for (const auto &e: config.asProps())
+		m_inputSources.push_back({e.first, BCReference(e.second).path()});
+}
+
+
+PropVal ExpressionBric::Variables::getConfig() const {
+	Props configProps;
+	for (const auto &var: m_inputSources) configProps[var.first] = BCReference(var.second);
+	return PropVal(std::move(configProps));
+}
+
+
+void ExpressionBric::Variables::connectInputs() {
+	dbrx_log_trace("Creating and connecting dynamic inputs of bric \"%s\"", absolutePath());
+	if (m_inputsConnected) throw logic_error("Can't connect already connected inputs in bric \"%s\""_format(absolutePath()));
+
+	for (const auto &var: m_inputSources)
+		connectInputToSiblingOrUp(*this, var.first, var.second);
+}
+
+
+void ExpressionBric::Variables::disconnectInputs() {
+	m_dynBrics.clear();
+}
+
+
+
+std::atomic<size_t> ExpressionBric::s_nCompiled{0};
+
+
+std::string ExpressionBric::generateCode(const std::string &functionName) {
+	m_varInputs.clear();
+
+	string code = "namespace dbrx_expressions {\ndouble %s(const void* const* args) {\n"_format(functionName);
+	for (const auto &in: vars.inputs()) {
+		const string varName = in.first.toString();
+		bool validName = !varName.empty() && !isdigit(varName.front());
+		for (char c: varName) validName = validName && (isalnum(c) || (c == '_'));
+		if (!validName) throw invalid_argument("Variable name \"%s\" of bric \"%s\" is not a valid C++ identifier"_format(varName, absolutePath()));
+
+		const string typeName = TypeReflection(in.second->value().typeInfo()).name();
+		code += "\tconst %s &%s = *static_cast<const %s*>(args[%s]);\n"_format(typeName, varName, typeName, m_varInputs.size());
+		m_varInputs.push_back(in.second);
+	}
+	code += "\treturn (%s);\n}\n}\n"_format(expression.get());
+
+	return code;
+}
+
+
+void ExpressionBric::init() {
+	if (expression.get().empty()) throw invalid_argument("No expression specified for bric \"%s\""_format(absolutePath()));
+
+	string functionName = "expr%s"_format(atomic_fetch_add(&s_nCompiled, size_t(1)));
+	string code = generateCode(functionName);
+	m_args.assign(m_varInputs.size(), nullptr);
+
+	dbrx_log_debug("Compiling expression of bric \"%s\":\n%s", absolutePath(), code);
+	if (! gInterpreter->Declare(code.c_str()))
+		throw runtime_error("Compilation of expression \"%s\" of bric \"%s\" failed"_format(expression.get(), absolutePath()));
+
+	m_function = reinterpret_cast<CompiledFunction>(
+		gInterpreter->ProcessLine("(long)&dbrx_expressions::%s;"_format(functionName).c_str())
+	);
+	if (m_function == nullptr)
+		throw runtime_error("Couldn't get compiled expression function of bric \"%s\""_format(absolutePath()));
+}
+
+
+void ExpressionBric::processInput() {
+	// Input values may have been reallocated, so look them up every time:
+	for (size_t i = 0; i < m_varInputs.size(); ++i) m_args[i] = m_varInputs[i]->value().untypedPtr();
+	output = m_function(m_args.data());
+}
+
+
 } // namespace dbrx
@@ -18,6 +18,10 @@
 #ifndef DBRX_FUNCBRICS_H
 #define DBRX_FUNCBRICS_H
 
+#include <atomic>
+#include <string>
+#include <vector>
+
 #include "Bric.h"
 
 
@@ -70,6 +74,81 @@ template<typename R, typename A, typename B> struct Divider final: public Binary
 };
 
 
+
+// Passes the input on if it is in the range [min, max), e.g. for energy
+// cuts. Dests must only use outputs of the filter, not the unfiltered
+// values it was derived from.
+template<typename T> class RangeFilter final: public FilterBric {
+public:
+	Input<T> input{this};
+
+	Param<T> min{this, "min", "Lower limit of range (inclusive)"};
+	Param<T> max{this, "max", "Upper limit of range (exclusive)"};
+
+	Output<T> output{this};
+
+	bool filterInput() override {
+		if ((input.get() >= min.get()) && (input.get() < max.get())) {
+			output = input.get();
+			return true;
+		} else return false;
+	}
+
+	using FilterBric::FilterBric;
+};
+
+
+
+
+// Evaluates a C++ expression (e.g. "offset + slope * mca") over the inputs
+// in vars, which may have any type. The expression is compiled once, by the
+// ROOT interpreter during init, so a whole sub-graph of function brics can
+// be replaced by a single native function call.
+class ExpressionBric: public TransformBric {
+public:
+	class Variables final: public DynInputGroup {
+	protected:
+		std::vector< std::pair<PropKey, PropPath> > m_inputSources;
+
+		void connectInputs() override;
+		void disconnectInputs() override;
+
+	public:
+		void applyConfig(const PropVal& config) override;
+		PropVal getConfig() const override;
+
+		void processInput() override {}
+
+		Variables() {}
+		Variables(Bric *parentBric, PropKey groupName): DynInputGroup(parentBric, groupName) {}
+	};
+
+protected:
+	using CompiledFunction = double (*)(const void* const* args);
+
+	static std::atomic<size_t> s_nCompiled;
+
+	CompiledFunction m_function = nullptr;
+	std::vector<const InputTerminal*> m_varInputs;
+	std::vector<const void*> m_args;
+
+	virtual std::string generateCode(const std::string &functionName);
+
+public:
+	Variables vars{this, "vars"};
+
+	Param<std::string> expression{this, "expression", "C++ expression over the variables in vars"};
+
+	Output<double> output{this};
+
+	void init() override;
+
+	void processInput() override;
+
+	using TransformBric::TransformBric;
+};
+
+
 } // namespace dbrx
 
 #endif // DBRX_FUNCBRICS_H
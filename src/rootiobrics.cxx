@@ -17,7 +17,16 @@
 
 #include "rootiobrics.h"
 
-#include <TH1.h>
+#include <algorithm>
+#include <cstring>
+
+#include <TClass.h>
+#include <TEnv.h>
+#include <TLeaf.h>
+#include <TMath.h>
+#include <TROOT.h>
+#include <TTreeCacheUnzip.h>
+#include <RVersion.h>
 
 #include "logging.h"
 #include "RootIO.h"
@@ -39,7 +48,134 @@ void RootTreeReader::Entry::connectBranches(Bric* contextBric, TTree* inputTree)
 }
 
 
+void RootTreeReader::configureReading() {
+	// Implicit MT, parallel unzipping, asynchronous prefetching and the
+	// number of cache learning entries are global ROOT settings. They are
+	// also used while reading (e.g. when the chain opens its next file), so
+	// they can't be restored after the setup here (see parameter docs).
+
+	if (implicitMT >= 0) {
+#ifdef R__USE_IMT
+		if (! ROOT::IsImplicitMTEnabled()) {
+			dbrx_log_info("Enabling ROOT implicit multi-threading for bric \"%s\"", absolutePath());
+			ROOT::EnableImplicitMT(UInt_t(implicitMT));
+		}
+		// Decompress the baskets in the cache in parallel, too (has to be
+		// set before the cache is created):
+		TTreeCacheUnzip::SetParallelUnzip(TTreeCacheUnzip::kEnable);
+		m_chain->SetImplicitMT(true);
+#else
+		dbrx_log_warn("ROOT doesn't support implicit multi-threading, ignoring implicitMT for bric \"%s\"", absolutePath());
+#endif
+	}
+
+	// Asynchronous prefetching has to be enabled before the cache is created:
+	if (asyncPrefetch) {
+		dbrx_log_debug("Enabling ROOT asynchronous prefetching for bric \"%s\"", absolutePath());
+		gEnv->SetValue("TFile.AsyncPrefetching", 1);
+	}
+
+	if (cacheLearnEntries > 0) m_chain->SetCacheLearnEntries(Int_t(cacheLearnEntries));
+
+	m_chain->SetCacheSize(cacheSize);
+}
+
+
+void RootTreeReader::initBulkRead() {
+	m_bulkColumns.clear();
+	m_bulkReadActive = false;
+	m_treeNumber = -1;
+	if (! bulkRead) return;
+
+#if ROOT_VERSION_CODE >= ROOT_VERSION(6,14,0)
+	m_chain->LoadTree(firstEntry);
+	TTree *tree = m_chain->GetTree();
+
+	for (const auto &elem: entry.outputs()) {
+		OutputTerminal *terminal = elem.second;
+		BulkColumn column;
+		column.value = &terminal->value();
+		column.branchName = terminal->name().toString();
+
+		TBranch *branch = (tree != nullptr) ? tree->GetBranch(column.branchName.c_str()) : nullptr;
+		TLeaf *leaf = (branch != nullptr) ? dynamic_cast<TLeaf*>(branch->GetListOfLeaves()->At(0)) : nullptr;
+		if (
+			(leaf == nullptr) || !TypeReflection(column.value->typeInfo()).isPrimitive() ||
+			(branch->GetListOfLeaves()->GetEntries() != 1) || (leaf->GetLen() != 1) ||
+			!branch->SupportsBulkRead()
+		) {
+			dbrx_log_info("Branch \"%s\" doesn't support bulk reading, using per-entry reading in bric \"%s\"", column.branchName, absolutePath());
+			m_bulkColumns.clear();
+			return;
+		}
+
+		column.elemSize = size_t(leaf->GetLenType());
+		column.buffer = unique_ptr<TBufferFile>(new TBufferFile(TBuffer::kWrite, 10000));
+		m_bulkColumns.push_back(std::move(column));
+	}
+
+	dbrx_log_debug("Bulk reading %s branches in bric \"%s\"", m_bulkColumns.size(), absolutePath());
+	m_bulkReadActive = true;
+#else
+	dbrx_log_warn("ROOT doesn't support bulk reading, ignoring bulkRead for bric \"%s\"", absolutePath());
+#endif
+}
+
+
+void RootTreeReader::bulkReadEntry() {
+#if ROOT_VERSION_CODE >= ROOT_VERSION(6,14,0)
+	Long64_t localEntry = m_chain->LoadTree(index);
+	if (localEntry < 0) throw runtime_error("Failed to load entry %s in bric \"%s\""_format(index.get(), absolutePath()));
+
+	if (m_chain->GetTreeNumber() != m_treeNumber) {
+		m_treeNumber = m_chain->GetTreeNumber();
+		for (auto &column: m_bulkColumns) {
+			column.branch = m_chain->GetTree()->GetBranch(column.branchName.c_str());
+			if (column.branch == nullptr) throw runtime_error("Branch \"%s\" not found"_format(column.branchName));
+			column.begin = column.end = 0;
+		}
+	}
+
+	for (auto &column: m_bulkColumns) {
+		if ((localEntry < column.begin) || (localEntry >= column.end)) {
+			// Bulk reads return whole baskets:
+			TBranch *branch = column.branch;
+			Int_t basketNo = TMath::BinarySearch(branch->GetWriteBasket() + 1, branch->GetBasketEntry(), localEntry);
+			column.buffer->Reset();
+			Int_t n = branch->GetBulkRead().GetEntriesDeserialized(localEntry, *column.buffer);
+			if (n <= 0) throw runtime_error("Bulk reading of branch \"%s\" failed at entry %s"_format(column.branchName, index.get()));
+			column.begin = branch->GetBasketEntry()[basketNo];
+			column.end = column.begin + n;
+			column.data = column.buffer->GetCurrent();
+		}
+		memcpy(column.value->untypedPtr(), column.data + (localEntry - column.begin) * column.elemSize, column.elemSize);
+	}
+#endif
+}
+
+
+bool RootTreeReader::pipelineCanSwapOutput(const OutputTerminal &output) const {
+	// Connected branches are read completely for each entry. ROOT objects
+	// are copied when swapped, so they're better copied just once:
+	if (&output.parent() != &entry) return false;
+	TypeReflection trefl(output.value().typeInfo());
+	return trefl.isPrimitive() || (trefl.getTClass()->GetCollectionProxy() != nullptr);
+}
+
+
+bool RootTreeReader::setPartition(size_t partIdx, size_t nParts) {
+	if ((nParts < 1) || (partIdx >= nParts)) throw invalid_argument("Invalid partition %s of %s for bric \"%s\""_format(partIdx, nParts, absolutePath()));
+	m_partIdx = partIdx;
+	m_nParts = nParts;
+	return true;
+}
+
+
 void RootTreeReader::processInput() {
+	// Selection refers to the previous chain:
+	if (m_chain) m_chain->SetNotify(nullptr);
+	m_selection.reset();
+
 	auto inputTChain = dynamic_cast<const TChain*>(input.value().ptr());
 	if (inputTChain != nullptr) {
 		// If input is a TChain, we can simply clone it
@@ -58,30 +194,154 @@ void RootTreeReader::processInput() {
 		m_chain->Add(fileName.c_str());
 	}
 
-	m_chain->SetCacheSize(cacheSize);
+	configureReading();
 	m_chain->SetBranchStatus("*", false);
 
 	entry.connectBranches(this, m_chain.get());
+	initSelection();
+	initBulkRead();
 
 	index = firstEntry - 1;
 	size = m_chain->GetEntries() - firstEntry.get();
 	if (ssize_t(nEntries) > 0) size = std::min(ssize_t(nEntries), size.get());
+
+	if (m_nParts > 1) {
+		ssize_t nSelected = std::max(ssize_t(0), size.get());
+		ssize_t partBegin = nSelected * ssize_t(m_partIdx) / ssize_t(m_nParts);
+		ssize_t partEnd = nSelected * ssize_t(m_partIdx + 1) / ssize_t(m_nParts);
+		dbrx_log_debug("Reading entries %s to %s of %s selected entries (partition %s of %s) in bric \"%s\""_format(partBegin, partEnd, nSelected, m_partIdx, m_nParts, absolutePath()));
+		index = firstEntry + partBegin - 1;
+		size = partEnd - partBegin;
+	}
+
+	m_endEntry = index.get() + 1 + size.get();
+}
+
+
+void RootTreeReader::initSelection() {
+	if (selection.get().empty()) return;
+
+	dbrx_log_debug("Using entry selection \"%s\" in bric \"%s\"", selection.get(), absolutePath());
+	m_selection = unique_ptr<TTreeFormula>(new TTreeFormula("selection", selection.get().c_str(), m_chain.get()));
+	if (m_selection->GetNdim() == 0) throw invalid_argument("Invalid selection \"%s\" in bric \"%s\""_format(selection.get(), absolutePath()));
+
+	// Formula leaves have to be updated when the chain switches trees:
+	m_chain->SetNotify(m_selection.get());
+
+	for (Int_t i = 0; i < m_selection->GetNcodes(); ++i) {
+		TLeaf *leaf = m_selection->GetLeaf(i);
+		if (leaf == nullptr) continue;
+		const char *bName = leaf->GetBranch()->GetName();
+		m_chain->SetBranchStatus(bName, true);
+		m_chain->AddBranchToCache(bName);
+	}
+}
+
+
+bool RootTreeReader::entrySelected() {
+	if (! m_selection) return true;
+
+	if (m_chain->LoadTree(index) < 0) throw runtime_error("Failed to load entry %s in bric \"%s\""_format(index.get(), absolutePath()));
+
+	// EvalInstance loads the branches needed by the formula for the entry:
+	Int_t n = m_selection->GetNdata();
+	for (Int_t i = 0; i < n; ++i) if (m_selection->EvalInstance(i) != 0) return true;
+	return false;
+}
+
+
+void RootTreeReader::provideEntryValues() {
+	// Provide (possibly recycled) objects for entries taken over or
+	// released by the dests, ROOT would allocate new ones otherwise:
+	for (const auto &elem: entry.outputs()) {
+		WritableValue &value = elem.second->value();
+		if (value.empty()) value.setToDefault();
+	}
+}
+
+
+void RootTreeReader::readEntry() {
+	if (m_bulkReadActive) {
+		bulkReadEntry();
+		return;
+	}
+
+	if (cacheLearnEntries < 0) {
+		// The cache of a chain is reset for each tree, which restarts
+		// the learning phase:
+		m_chain->LoadTree(index);
+		if (m_chain->GetTreeNumber() != m_treeNumber) {
+			m_treeNumber = m_chain->GetTreeNumber();
+			m_chain->StopCacheLearningPhase();
+		}
+	}
+	m_chain->GetEntry(index);
 }
 
 
 bool RootTreeReader::nextOutput() {
-	if (index.get() + 1 < firstEntry.get() + size.get()) {
+	// Loading a tree for the selection may already access the entry values:
+	provideEntryValues();
+
+	while (index.get() + 1 < m_endEntry) {
 		++index;
-		m_chain->GetEntry(index);
-		return true;
-	} else return false;
+		if (entrySelected()) {
+			readEntry();
+			return true;
+		}
+	}
+	return false;
+}
+
+
+RootTreeReader::~RootTreeReader() {
+	// Selection is deleted before the chain:
+	if (m_chain) m_chain->SetNotify(nullptr);
+}
+
+
+
+void RootTreeEntryListReader::processInput() {
+	RootTreeReader::processInput();
+
+	// Entries are read in ascending order, so entries in the same cluster
+	// are read one after another and each basket is only read and
+	// decompressed once:
+	ssize_t rangeBegin = index.get() + 1;
+	m_entries.clear();
+	for (ssize_t e: entries.get()) if ((e >= rangeBegin) && (e < m_endEntry)) m_entries.push_back(e);
+	sort(m_entries.begin(), m_entries.end());
+	m_entries.erase(unique(m_entries.begin(), m_entries.end()), m_entries.end());
+	m_entryPos = 0;
+
+	dbrx_log_debug("Reading %s selected entries of %s in bric \"%s\"", m_entries.size(), size.get(), absolutePath());
+
+	// Don't let the cache prefetch clusters outside of the selected range:
+	if (! m_entries.empty()) m_chain->SetCacheEntryRange(m_entries.front(), m_entries.back() + 1);
+
+	size = m_entries.size();
+}
+
+
+bool RootTreeEntryListReader::nextOutput() {
+	provideEntryValues();
+
+	while (m_entryPos < m_entries.size()) {
+		index = m_entries[m_entryPos++];
+		if (entrySelected()) {
+			readEntry();
+			return true;
+		}
+	}
+	return false;
 }
 
 
 
 TTree* RootTreeWriter::newTree(TDirectory *directory) {
-	TempChangeOfTDirectory outTDir(directory);
-	return new TTree(treeName.get().c_str(), treeTitle.get().c_str());
+	TTree *tree = new TTree(treeName.get().c_str(), treeTitle.get().c_str());
+	tree->SetDirectory(directory);
+	return tree;
 }
 
 
@@ -134,14 +394,20 @@ void RootTreeWriter::newReduction() {
 	// Dummy output tree:
 	output.value() = unique_ptr<TTree>(newTree(localTDirectory()));
 
-	// Actual output trees, created directly inside TDirectories of consumers:
 	m_trees.clear();
-	for (auto &getDir: m_outputDirProviders) {
-		TDirectory* targetDirectory = getDir();
-		dbrx_log_debug("Creating new TTree \"%s\" as output of bric \"%s\" in TDirectory \"%s\" ", treeName.get(), absolutePath(), targetDirectory->GetPath());
-		TTree* tree = newTree(targetDirectory);
-		entry.createOutputBranches(tree);
-		m_trees.push_back(tree);
+	if (! partialReduction()) {
+		// Actual output trees, created directly inside TDirectories of consumers:
+		for (auto &getDir: m_outputDirProviders) {
+			TDirectory* targetDirectory = getDir();
+			dbrx_log_debug("Creating new TTree \"%s\" as output of bric \"%s\" in TDirectory \"%s\" ", treeName.get(), absolutePath(), targetDirectory->GetPath());
+			TTree* tree = newTree(targetDirectory);
+			entry.createOutputBranches(tree);
+			m_trees.push_back(tree);
+		}
+	} else {
+		// Partial result is kept in the (in-memory) output tree, to be merged:
+		entry.createOutputBranches(&output.get());
+		m_trees.push_back(&output.get());
 	}
 }
 
@@ -158,6 +424,17 @@ void RootTreeWriter::finalizeReduction() {
 }
 
 
+void RootTreeWriter::mergeReduction(const AbstractReducerBric &other) {
+	const RootTreeWriter &otherWriter = dynamic_cast<const RootTreeWriter&>(other);
+	if (otherWriter.m_trees.empty()) throw runtime_error("Can't merge output of bric \"%s\" into bric \"%s\", no tree was filled"_format(other.absolutePath(), absolutePath()));
+	TTree *source = otherWriter.m_trees.front();
+	for (auto tree: m_trees) {
+		dbrx_log_debug("Merging %s entries from tree of bric \"%s\" into output tree \"%s/%s\" of \"%s\"", source->GetEntries(), other.absolutePath(), tree->GetDirectory()->GetPath(), tree->GetName(), absolutePath());
+		tree->CopyEntries(source);
+	}
+}
+
+
 
 Bric::InputTerminal* RootFileReader::ContentGroup::connectInputToInner(Bric &bric, PropKey inputName, PropPath::Fragment sourcePath) {
 	if (sourcePath.size() >= 2) subGroup(sourcePath.front());
@@ -324,17 +601,16 @@ RootFileWriter::ContentGroup& RootFileWriter::ContentGroup::subGroup(PropKey nam
 
 
 void RootFileWriter::ContentGroup::processInput() {
-	TempChangeOfTDirectory tDirChange(m_outputDir);
-
 	for (auto &si: m_sourceInfos) {
 		const Bric* source = si.first;
 		SourceInfo &info = si.second;
 		if (info.inputCounter < outputCounterOn(*source)) {
 			info.inputCounter = outputCounterOn(*source);
-			for (const Terminal* input: info.inputs) {
+			for (InputTerminal* input: info.inputs) {
 
+				bool isWrapped = input->value().isPtrAssignableTo(typeid(AbstractWrappedTObj));
 				const TNamed *inputObject = nullptr;
-				if (input->value().isPtrAssignableTo(typeid(AbstractWrappedTObj))) {
+				if (isWrapped) {
 					const AbstractWrappedTObj *inputWrappedTObj = input->value().typedPtr<AbstractWrappedTObj>();
 					inputObject = (const TNamed*)inputWrappedTObj->getPtr();
 				} else {
@@ -344,11 +620,23 @@ void RootFileWriter::ContentGroup::processInput() {
 				if (typeid(*inputObject) == typeid(TTree)) {
 					// TTree is special - it or a clone of it should already be inside m_outputDir:
 					dbrx_log_trace("No further action necessary for output of TTree \"%s\" to content group \"%s\"", inputObject->GetName(), absolutePath());
+				} else if (input->canTake()) {
+					// Content group is the only consumer, so the object can be taken over:
+					dbrx_log_trace("Taking over object \"%s\" for content group \"%s\"", inputObject->GetName(), absolutePath());
+					void *content = input->untypedTake();
+					TNamed *outputObject = nullptr;
+					if (isWrapped) {
+						unique_ptr<AbstractWrappedTObj> wrapper((AbstractWrappedTObj*)content);
+						outputObject = (TNamed*) wrapper->releaseTObj().release();
+					} else {
+						outputObject = (TNamed*) content;
+					}
+					writeObject(outputObject, m_outputDir);
 				} else {
 					// Need to clone inputObject to own it:
 					dbrx_log_trace("Cloning object \"%s\" to content group \"%s\"", inputObject->GetName(), absolutePath());
 					TNamed *outputObject = (TNamed*) inputObject->Clone();
-					writeObject(outputObject);
+					writeObject(outputObject, m_outputDir);
 				}
 			}
 		}
@@ -420,18 +708,19 @@ RootFileWriter::ContentGroup::ContentGroup(RootFileWriter *writer, Bric *parentB
 
 
 
-void RootFileWriter::writeObject(TNamed *obj) {
+void RootFileWriter::writeObject(TNamed *obj, TDirectory *directory) {
 	if (string(obj->GetName()).empty())
 		throw invalid_argument("Refusing to add object with empty name to TDirectory");
 
-	bool autoAdded = (
-		TH1::AddDirectoryStatus() &&
-			(dynamic_cast<TH1*>(obj) != 0)
-	) || (
-		TDirectory::AddDirectoryStatus() && (obj->IsA()->GetDirectoryAutoAdd() != nullptr)
-	);
-
-	if (!autoAdded) obj->Write();
+	ROOT::DirAutoAdd_t addToDirectory = obj->IsA()->GetDirectoryAutoAdd();
+	if (addToDirectory != nullptr) {
+		// Object (e.g. a histogram) will be owned by the directory and
+		// written together with the file:
+		addToDirectory(obj, directory);
+	} else {
+		directory->WriteTObject(obj);
+		delete obj;
+	}
 }
 
 
@@ -466,7 +755,10 @@ void RootFileWriter::openOutputForWrite() {
 	const char *outFileName = fileName->c_str();
 	const char *outFileTitle = title->c_str();
 	dbrx_log_debug("Creating TFile \"%s\" with title \"%s\" in bric \"%s\""_format(outFileName, outFileTitle, absolutePath()));
+	// TFile::Open changes gDirectory, restore it afterwards:
+	TempChangeOfTDirectory restoreTDir(gDirectory);
 	TFile *tfile = TFile::Open(outFileName, "RECREATE", outFileTitle);
+	restoreTDir.release();
 	if (tfile == nullptr) throw runtime_error("Could not create TFile \"%s\""_format(outFileName));
 	outputFile.value() = unique_ptr<TFile>(tfile);
 
@@ -26,6 +26,8 @@
 #include <TFile.h>
 #include <TTree.h>
 #include <TChain.h>
+#include <TBufferFile.h>
+#include <TTreeFormula.h>
 
 namespace dbrx {
 
@@ -33,6 +35,53 @@ namespace dbrx {
 class RootTreeReader: public MapperBric {
 protected:
 	std::unique_ptr<TChain> m_chain;
+	std::unique_ptr<TTreeFormula> m_selection;
+
+	size_t m_partIdx = 0;
+	size_t m_nParts = 1;
+	ssize_t m_endEntry = 0;
+
+	Int_t m_treeNumber = -1;
+
+	// Column buffer for bulk reading of a primitive branch, holds the
+	// entries [begin, end) of the current tree.
+	struct BulkColumn {
+		WritableValue *value = nullptr;
+		std::string branchName;
+		size_t elemSize = 0;
+		TBranch *branch = nullptr;
+		std::unique_ptr<TBufferFile> buffer;
+		const char *data = nullptr;
+		Long64_t begin = 0;
+		Long64_t end = 0;
+	};
+
+	std::vector<BulkColumn> m_bulkColumns;
+	bool m_bulkReadActive = false;
+
+	virtual void configureReading() final;
+
+	// Sets up bulk reading if requested and if all connected branches
+	// support it
+	virtual void initBulkRead() final;
+
+	// Reads the current entry from the column buffers, refilling them
+	// basket by basket
+	virtual void bulkReadEntry() final;
+
+	// Sets up the selection formula, if a selection is given
+	virtual void initSelection() final;
+
+	// Evaluates the selection for entry index, only reads the branches
+	// used in the selection
+	virtual bool entrySelected() final;
+
+	// Provides objects for empty entry outputs, must be called before
+	// entrySelected and readEntry
+	virtual void provideEntryValues() final;
+
+	// Reads entry index into the entry outputs
+	virtual void readEntry() final;
 
 public:
 	class Entry final: public DynOutputGroup {
@@ -44,6 +93,39 @@ public:
 	Input<TTree> input{this};
 
 	Param<int64_t> cacheSize{this, "cacheSize", "Input read-ahead cache size (-1 for default)", -1};
+
+	// The TTreeCache learning phase determines which branches to cache.
+	// Only connected branches are read anyway, and they are added to the
+	// cache explicitly, so learning can usually be skipped. Note: A number
+	// of learning entries > 0 is a global ROOT setting, it applies to all
+	// trees read afterwards in the process and is not reset.
+	Param<int64_t> cacheLearnEntries{this, "cacheLearnEntries", "Entries in the TTreeCache learning phase (0 for default, -1 to skip learning, > 0 is global)", 0};
+
+	// Reading (and decompression) of branches and baskets on the thread
+	// pool of ROOT's implicit multi-threading. Note: Implicit
+	// multi-threading (if not yet enabled, with the given number of
+	// threads) and parallel unzipping of cached baskets are enabled
+	// globally, for all trees read afterwards in the process, and are not
+	// disabled again.
+	Param<int32_t> implicitMT{this, "implicitMT", "Use ROOT implicit multi-threading to read and decompress baskets (number of threads, 0 for ROOT default, -1 to disable, enabling is global)", -1};
+
+	// Prefetch the baskets of the next cluster(s) on a background thread,
+	// using ROOT's asynchronous prefetching. Note: This sets the global
+	// ROOT setting "TFile.AsyncPrefetching", so it applies to all files
+	// read afterwards in the process and is not reset.
+	Param<bool> asyncPrefetch{this, "asyncPrefetch", "Prefetch baskets of the next clusters on a background thread (global)", false};
+
+	// Read flat trees (only primitive branches with a single value per
+	// entry connected) basket by basket, via ROOT's bulk I/O, into column
+	// buffers, and step through them instead of calling TTree::GetEntry
+	// for each entry. Falls back to GetEntry for other trees.
+	Param<bool> bulkRead{this, "bulkRead", "Read primitive branches basket by basket into column buffers", false};
+
+	// Entries for which the selection (a TTreeFormula expression, like for
+	// TTree::Draw) is false, resp. zero for all instances, are skipped. The
+	// connected branches are only read for selected entries. The size
+	// output still counts all entries in the selected range.
+	Param<std::string> selection{this, "selection", "Entry selection expression (empty to read all entries)", ""};
 	Param<int64_t> nEntries{this, "nEntries", "Number of entries to read (-1 for all)", -1};
 	Param<int64_t> firstEntry{this, "firstEntry", "First entry to read", 0};
 
@@ -52,15 +134,46 @@ public:
 	Output<ssize_t> size{this, "size", "Number of entries"};
 	Output<ssize_t> index{this, "index", "Number of entries"};
 
+	// Splits the selected entry range into nParts contiguous sub-ranges
+	bool setPartition(size_t partIdx, size_t nParts) override;
+
 	void processInput() override;
 
 	bool nextOutput() override;
 
+	// Entry outputs of primitive and STL collection types are read ahead
+	// into the pipeline buffers without copying
+	bool pipelineCanSwapOutput(const OutputTerminal &output) const override;
+
+	~RootTreeReader() override;
+
 	using MapperBric::MapperBric;
 };
 
 
 
+// Reads only the tree entries given by the entries input, e.g. the indices
+// of the entries selected by a first pass over the tree, collected by a
+// CollBuilderBric<std::vector<ssize_t>> from the index output of a
+// RootTreeReader. Entries outside of the range given by firstEntry,
+// nEntries and the partition are ignored.
+class RootTreeEntryListReader: public RootTreeReader {
+protected:
+	std::vector<ssize_t> m_entries;
+	size_t m_entryPos = 0;
+
+public:
+	Input<std::vector<ssize_t>> entries{this, "entries", "Entries to read"};
+
+	void processInput() override;
+
+	bool nextOutput() override;
+
+	using RootTreeReader::RootTreeReader;
+};
+
+
+
 class RootTreeWriter: public ReducerBric {
 protected:
 	std::vector< std::function<TDirectory*()> > m_outputDirProviders;
@@ -99,12 +212,18 @@ public:
 
 	Output<TTree> output{this, "", "Output Tree"};
 
+	// Filling a tree may write to its (possibly shared) file
+	bool canRunConcurrently() const override { return false; }
+
 	void newReduction() override;
 
 	void processInput() override;
 
 	void finalizeReduction() override;
 
+	// Appends the entries of the other writer's tree to the output trees
+	void mergeReduction(const AbstractReducerBric &other) override;
+
 	using ReducerBric::ReducerBric;
 };
 
@@ -157,7 +276,7 @@ class RootFileWriter: public AsyncReducerBric {
 protected:
 	static const PropKey s_thisDirName;
 
-	static void writeObject(TNamed *obj);
+	static void writeObject(TNamed *obj, TDirectory *directory);
 
 	bool m_outputReadyForWrite = false;
 
@@ -168,7 +287,7 @@ public:
 	protected:
 		struct SourceInfo {
 			size_t inputCounter;
-			std::vector<const Terminal*> inputs;
+			std::vector<InputTerminal*> inputs;
 		};
 
 		RootFileWriter* m_writer;
@@ -19,6 +19,7 @@
 #define DBRX_TEXTBRICS_H
 
 #include <iostream>
+#include <sstream>
 
 #include "Bric.h"
 #include "ManagedStream.h"
@@ -48,6 +49,12 @@ public:
 template<typename T> class TextFilePrinter: public ReducerBric {
 protected:
 	ManagedOutputStream m_outputStream;
+	std::ostringstream m_buffer;
+
+	// Partial reductions are buffered, to be written on merge
+	std::ostream& outputStream() { return partialReduction() ? m_buffer : m_outputStream.stream(); }
+
+	virtual void openOutput(bool append);
 
 public:
 	Input<T> input{this, "", "Input value"};
@@ -62,24 +69,39 @@ public:
 
 	void finalizeReduction();
 
+	// Appends the output of the other printer, which has to perform a
+	// partial reduction, to the output of this one.
+	void mergeReduction(const AbstractReducerBric &other);
+
 	using ReducerBric::ReducerBric;
 };
 
 
-template<typename T> void TextFilePrinter<T>::newReduction() {
+template<typename T> void TextFilePrinter<T>::openOutput(bool append) {
 	dbrx_log_trace("TextFilePrinter \"%s\", opening output \"%s\""_format(absolutePath(), target.get()));
 	try {
-		m_outputStream.open(target);
+		if (append) m_outputStream.openForAppend(target);
+		else m_outputStream.open(target);
 	} catch (std::runtime_error &e) {
-		throw runtime_error("Can't open \"%s\" for output in bric \"%s\": %s"_format(target.get(), absolutePath(), e.what()));
+		throw std::runtime_error("Can't open \"%s\" for output in bric \"%s\": %s"_format(target.get(), absolutePath(), e.what()));
 	}
 }
 
 
+template<typename T> void TextFilePrinter<T>::newReduction() {
+	output = ssize_t(0);
+	m_buffer.str("");
+	m_buffer.clear();
+	if (! partialReduction()) openOutput(false);
+}
+
+
 template<typename T> void TextFilePrinter<T>::processInput() {
 	using namespace std;
-	m_outputStream.stream() << input.get() << '\n' << flush;
-	if (! m_outputStream.stream()) throw runtime_error("Output to \"%s\" failed in bric \"%s\""_format(target.get(), absolutePath()));
+	outputStream() << input.get() << '\n';
+	if (! partialReduction()) outputStream() << flush;
+	if (! outputStream()) throw runtime_error("Output to \"%s\" failed in bric \"%s\""_format(target.get(), absolutePath()));
+	++output.get();
 }
 
 
@@ -89,6 +111,24 @@ template<typename T> void TextFilePrinter<T>::finalizeReduction() {
 }
 
 
+template<typename T> void TextFilePrinter<T>::mergeReduction(const AbstractReducerBric &other) {
+	using namespace std;
+	const TextFilePrinter &otherPrinter = dynamic_cast<const TextFilePrinter&>(other);
+	if (! otherPrinter.partialReduction())
+		throw runtime_error("Can't merge output of bric \"%s\" into bric \"%s\", not a partial reduction"_format(other.absolutePath(), absolutePath()));
+
+	if (partialReduction()) {
+		m_buffer << otherPrinter.m_buffer.str();
+	} else {
+		openOutput(true);
+		m_outputStream.stream() << otherPrinter.m_buffer.str() << flush;
+		if (! m_outputStream.stream()) throw runtime_error("Output to \"%s\" failed in bric \"%s\""_format(target.get(), absolutePath()));
+		m_outputStream.close();
+	}
+	output = output.get() + otherPrinter.output.value().get();
+}
+
+
 using TextFileWriter = TextFilePrinter<std::string>;
 
 